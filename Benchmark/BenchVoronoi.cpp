@@ -0,0 +1,185 @@
+/******************************************************************************
+ Benchmark for throughput of DrawVoronoi into an offscreen pixmap.
+
+ Usage: BenchVoronoi [seconds [workers]]
+
+ Each configuration is timed for at least the given number of seconds (default 0.2).
+ Drawing uses the given number of workers (default is the number of hardware threads).
+ Output is one line of comma-separated values per configuration.
+*******************************************************************************/
+
+#include "AssertLib.h"
+#include "Geometry.h"
+#include "NimbleDraw.h"
+#include "Outline.h"
+#include "Parallel.h"
+#include "Region.h"
+#include "Utility.h"
+#include "Voronoi.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+//! Kind of distribution of sites.
+enum class Distribution : int8_t {
+    uniform,        // Uniform over the window
+    clustered,      // Gaussian clusters, as when beetles swarm
+    honeycomb,      // Jittered honeycomb, as in Pond::initialize
+    nearDuplicate,  // Pairs of sites less than a pixel apart
+    rows            // Square grid, so that each row of sites has equal y
+};
+
+template<>
+constexpr Distribution EnumMax<Distribution> = Distribution::rows;
+
+namespace {
+
+const char* NameOf(Distribution d) {
+    switch (d) {
+        case Distribution::uniform: return "uniform";
+        case Distribution::clustered: return "clustered";
+        case Distribution::honeycomb: return "honeycomb";
+        case Distribution::nearDuplicate: return "nearDuplicate";
+        case Distribution::rows: return "rows";
+    }
+    Assert(false);
+    return "";
+}
+
+//! Random point from a standard normal distribution in each coordinate.
+Point RandomGaussian() {
+    float r = std::sqrt(-2*std::log(1-RandomFloat(1)));
+    return Polar(r, RandomAngle());
+}
+
+//! Generate n sites within a width x height window.
+std::vector<Point> MakeSites(Distribution d, size_t n, int width, int height) {
+    std::vector<Point> p;
+    p.reserve(n);
+    auto clamp = [=](Point q) {
+        return Point(Clip(0.0f, width-0.01f, q.x), Clip(0.0f, height-0.01f, q.y));
+    };
+    switch (d) {
+        case Distribution::uniform:
+            while (p.size()<n)
+                p.push_back(Point(RandomFloat(width), RandomFloat(height)));
+            break;
+        case Distribution::clustered: {
+            const size_t nCluster = 1+n/200;
+            std::vector<Point> center(nCluster);
+            for (Point& c: center)
+                c = Point(RandomFloat(width), RandomFloat(height));
+            const float sigma = 0.05f*Min(width, height);
+            while (p.size()<n)
+                p.push_back(clamp(center[RandomUInt(uint32_t(nCluster))]+sigma*RandomGaussian()));
+            break;
+        }
+        case Distribution::honeycomb: {
+            // Same layout as Pond::initialize, but filling the window instead of a circle.
+            const float base = std::sqrt(2*float(width)*height/(std::sqrt(3.0f)*n));
+            const float alt = std::sqrt(3.0f)/2*base;
+            for (int i=0; p.size()<n; ++i)
+                for (int j=0; p.size()<n && j*base<width; ++j) {
+                    Point q((i&1) ? j*base : (j+0.5f)*base, i*alt);
+                    q += Polar(base/4.f, RandomAngle());
+                    p.push_back(clamp(q));
+                }
+            break;
+        }
+        case Distribution::nearDuplicate:
+            while (p.size()<n) {
+                Point q(RandomFloat(width), RandomFloat(height));
+                p.push_back(q);
+                if (p.size()<n)
+                    p.push_back(clamp(q+Polar(RandomFloat(0.5f), RandomAngle())));
+            }
+            break;
+        case Distribution::rows: {
+            const float spacing = std::sqrt(float(width)*height/n);
+            for (int i=0; p.size()<n; ++i)
+                for (int j=0; p.size()<n && j*spacing<width; ++j)
+                    p.push_back(clamp(Point((j+0.5f)*spacing, (i+0.5f)*spacing)));
+            break;
+        }
+    }
+    return p;
+}
+
+struct Result {
+    double mean;        // Mean seconds per frame
+    double stddev;      // Standard deviation of seconds per frame
+    size_t reps;        // Number of frames timed
+};
+
+//! Time drawing the given sites into window.
+/** Frames taller than MAX_STRIPE_HEIGHT are drawn as several bands, each with all the sites. */
+Result TimeDraw(NimblePixMap& window, const std::vector<Point>& sites, bool outlined, double minSeconds) {
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFFFFFF);
+    std::vector<Ant> master(sites.size()+2), ants(sites.size()+2);
+    master.front().assignFirstBookend();
+    for (size_t k=0; k<sites.size(); ++k)
+        master[k+1].assign(sites[k], OutlinedColor(RandomUInt(0x1000000), outlined ? exterior : 0));
+    master.back().assignLastBookend();
+
+    Result r;
+    auto frame = [&] {
+        for (int top=0; top<window.height(); top+=MAX_STRIPE_HEIGHT) {
+            // DrawVoronoi sorts the Ants, so each band starts from the same unsorted order.
+            std::copy(master.begin(), master.end(), ants.begin());
+            NimbleRect band(0, top, window.width(), Min(window.height(), top+MAX_STRIPE_HEIGHT));
+            DrawVoronoi(window, band, ants.data(), ants.data()+ants.size());
+        }
+    };
+    // Warm up buffers and caches.
+    frame();
+
+    std::vector<double> t;
+    double total = 0;
+    while (t.size()<5 || total<minSeconds) {
+        auto t0 = std::chrono::steady_clock::now();
+        frame();
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now()-t0;
+        t.push_back(dt.count());
+        total += dt.count();
+    }
+    r.reps = t.size();
+    r.mean = total/r.reps;
+    double sum2 = 0;
+    for (double x: t)
+        sum2 += (x-r.mean)*(x-r.mean);
+    r.stddev = std::sqrt(sum2/(r.reps-1));
+    return r;
+}
+
+} // (anonymous)
+
+int main(int argc, char* argv[]) {
+    const double minSeconds = argc>1 ? std::atof(argv[1]) : 0.2;
+    const unsigned workers = argc>2 ? unsigned(std::atoi(argv[2])) : 0;
+    static const struct {int width, height; } resolution[] = {{1024, 768}, {1920, 1080}, {2560, 1440}, {3840, 2160}};
+    static const size_t siteCount[] = {100, 1000, 4000, 16000, 32000};
+
+    SetWorkerCount(workers);
+    std::printf("# workers=%u\n", WorkerCount());
+    std::printf("width,height,sites,distribution,outlined,reps,ms/frame,stddev%%,ns/pixel,ns/site\n");
+    for (const auto& res: resolution) {
+        NimblePixMapWithOwnership window(res.width, res.height);
+        const double nPixel = double(res.width)*res.height;
+        for (size_t n: siteCount)
+            for (Distribution d=Distribution(0); d<=EnumMax<Distribution>; d=Distribution(int(d)+1)) {
+                const std::vector<Point> sites = MakeSites(d, n, res.width, res.height);
+                for (bool outlined: {false, true}) {
+                    const Result r = TimeDraw(window, sites, outlined, minSeconds);
+                    std::printf("%d,%d,%zu,%s,%d,%zu,%.3f,%.1f,%.3f,%.1f\n", res.width, res.height, n, NameOf(d), int(outlined),
+                                r.reps, r.mean*1E3, 100*r.stddev/r.mean, r.mean*1E9/nPixel, r.mean*1E9/n);
+                    std::fflush(stdout);
+                }
+            }
+    }
+    const Outline::Stats& h = Outline::highWater();
+    std::printf("# outline high water: segments=%zu ids=%zu growths=%zu\n", h.segments, h.ids, h.growths);
+    return 0;
+}
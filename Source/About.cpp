@@ -33,6 +33,8 @@ public:
     void initialize();
     void update(float dt);
     Ant* copyToAnts(Ant* a, const ViewTransform& transform);
+    //! Number of Ants that copyToAnts generates.
+    size_t antCount() const { return myBugs.size(); }
     int width() const { return myPixMap.width(); }
     int height() const { return myPixMap.height(); }
 };
@@ -142,14 +144,12 @@ void About::draw(NimblePixMap& window) {
     const int32_t ha = TheAuthor.height();
     NimbleRect titleRect(wa, 0, window.width(), ha);
     NimbleRect infoRect(0, ha, window.width(), window.height());
-    CompoundRegion region;
-    region.buildRectangle(Point(0, 0), Point(window.width(), window.height()));
 
-    Ant* a = Ant::openBuffer();
+    Ant* a = Ant::openBuffer(TheAuthor.antCount()+TheTitle.antCountMax()+TheInfo.antCountMax()+AboutBackground.size());
     ViewTransform identity;
     a = TheAuthor.copyToAnts(a, identity);
     a = AssignAntsToFit(Rect[RectIndex::title], TheTitle, a);
     a = AssignAntsToFit(Rect[RectIndex::info], TheInfo, a);
     a = AboutBackground.copyToAnts(a, identity);
-    Ant::closeBufferAndDraw(window, region, a, true);
+    Ant::closeBufferAndDraw(window, NimbleRect(0, 0, window.width(), window.height()), a, true);
 }
\ No newline at end of file
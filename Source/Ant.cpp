@@ -15,8 +15,10 @@
 
 #include "Ant.h"
 #include "Host.h"
+#include "Sort.h"
 #include "Voronoi.h"
 #include <algorithm>
+#include <vector>
 
 namespace {
 
@@ -27,14 +29,14 @@ namespace {
 //! Always 0 or 1
 uint8_t CurrentHalf;
 
-//! "Old" and "new" buffers. 
-Ant AntArray[2][N_ANT_MAX];
+//! "Old" and "new" buffers.  Each grows to the most Ants that a frame has put in it.
+std::vector<Ant> AntArray[2];
 
 //! Positions where ants in "old" buffer are going to.
-Point To[N_ANT_MAX];
+std::vector<Point> To;
 
 //! Positions where ants in "new" buffer are coming from.
-Point From[N_ANT_MAX];
+std::vector<Point> From;
 
 //! Pointer to first non-bookend Ant in new half of AntArray
 Ant* BufferFirst;
@@ -42,6 +44,9 @@ Ant* BufferFirst;
 //! Pointer to on e past last non-bookend And in new half of Array
 Ant* BufferPtr;
 
+//! Pointer to one past the last Ant that the caller of openBuffer promised to write.
+Ant* BufferLimit;
+
 //! Pointer to first non-bookend Ant in old half of AntArray
 Ant* OldFirst;
 
@@ -50,17 +55,102 @@ Ant* OldLast;
 
 bool CutFlag;
 
+//! Maximum number of buffers per frame whose order is remembered.  Later buffers are sorted from scratch.
+constexpr size_t N_ORDERED_BUFFER_MAX = 16;
+
+//! PreviousOrder[b][k] is the position, in fill order, of the kth Ant by y in buffer b of the previous frame.
+std::vector<uint32_t> PreviousOrder[N_ORDERED_BUFFER_MAX];
+
+//! Number of buffers closed since clearBuffer.
+size_t BufferCount;
+
+//! Buffer closed by closeBuffer and not yet drawn.
+/** Ants are identified by offsets into the new half of AntArray, because the half may move when it grows. */
+struct ClosedBuffer {
+    const CompoundRegion* region;
+    size_t first;
+    size_t last;
+};
+
+//! Buffers to be drawn by drawClosedBuffers
+std::vector<ClosedBuffer> ClosedBuffers;
+
+//! Make room for n Ants after antLast in the new half of AntArray, and return where antLast is afterwards.
+/** If the half has to grow, Ants before antLast are moved, and pointers into the half are updated. */
+Ant* ReserveAnts(Ant* antLast, size_t n) {
+    std::vector<Ant>& v = AntArray[CurrentHalf];
+    const size_t m = antLast-v.data();
+    if (v.size()<m+n) {
+        const size_t first = BufferFirst-v.data();
+        const size_t ptr = BufferPtr-v.data();
+        const size_t limit = BufferLimit-v.data();
+        v.resize(RoundUpToPowerOfTwo(m+n));
+        BufferFirst = v.data()+first;
+        BufferPtr = v.data()+ptr;
+        BufferLimit = v.data()+limit;
+    }
+    return v.data()+m;
+}
+
+//! Sort Ants in [first,last) by y, starting from the given order, which is updated to the new order.
+/** When Ants move little between frames, the old order is nearly sorted and repairing it takes O(n) time. */
+void SortByY(Ant* first, Ant* last, std::vector<uint32_t>& order) {
+    const size_t n = last-first;
+    if (order.size()!=n) {
+        // Forget positions that no longer exist, and put new positions at the end.
+        order.erase(std::remove_if(order.begin(), order.end(), [n](uint32_t i) {return i>=n; }), order.end());
+        for (size_t i=order.size(); i<n; ++i)
+            order.push_back(uint32_t(i));
+    }
+    static std::vector<float> key;
+    if (key.size()<n)
+        key.resize(n);
+    for (size_t k=0; k<n; ++k)
+        key[k] = first[order[k]].y;
+    // Insertion sort, abandoned if the Ants moved past too many others.
+    size_t budget = 16*n;
+    for (size_t k=1; k<n; ++k) {
+        const float y = key[k];
+        const uint32_t i = order[k];
+        size_t j = k;
+        for (; j>0 && key[j-1]>y; --j) {
+            key[j] = key[j-1];
+            order[j] = order[j-1];
+        }
+        key[j] = y;
+        order[j] = i;
+        if (k-j>budget) {
+            std::sort(order.begin(), order.end(), [first](uint32_t a, uint32_t b) {return first[a].y<first[b].y; });
+            break;
+        }
+        budget -= k-j;
+    }
+    static std::vector<Ant> sorted;
+    if (sorted.size()<n)
+        sorted.resize(n);
+    for (size_t k=0; k<n; ++k)
+        sorted[k] = first[order[k]];
+    std::copy(sorted.begin(), sorted.begin()+n, first);
+}
+
 } // (anonymous)
 
 bool ShowAnts;
 
+bool PersistentAntOrder = true;
+
+bool CullAnts = true;
+
 void Ant::clearBuffer() {
-    BufferPtr = AntArray[CurrentHalf];
+    Assert(ClosedBuffers.empty());
+    BufferFirst = BufferPtr = BufferLimit = AntArray[CurrentHalf].data();
+    BufferCount = 0;
 }
 
-Ant* Ant::openBuffer() {
-    Assert(BufferPtr);
-    Ant* a = BufferFirst = BufferPtr;
+Ant* Ant::openBuffer(size_t n) {
+    // Room for the Ants and the two bookends
+    Ant* a = BufferFirst = ReserveAnts(BufferPtr, n+2);
+    BufferLimit = a+1+n;
     (a++)->assignFirstBookend();
     return a;
 }
@@ -68,7 +158,7 @@ Ant* Ant::openBuffer() {
 void Ant::switchBuffer() {
     Assert(CurrentHalf<2);
     // Save pointers to beginning and ending of current buffer
-    OldFirst = AntArray[CurrentHalf]+1;
+    OldFirst = AntArray[CurrentHalf].data()+1;
     OldLast = BufferPtr-1;
     Assert(OldFirst[-1].y==-AntInfinity);
     Assert(OldLast[0].y==AntInfinity);
@@ -96,20 +186,25 @@ static Ant* AntCutCompose(NimblePixMap& window, Ant* antLast) {
     Assert(BufferFirst->y == -AntInfinity);
     static double baseTime;
     double globalTime = HostClockTime();
+    // Buffers after a cut may have more Ants than the first one.  The extra ones come from the origin.
+    const size_t n = antLast-(BufferFirst+1);
+    if (From.size()<n)
+        From.resize(n, Point(0, 0));
     if (CutFlag) {
         CutFlag = false;
         baseTime = globalTime;
         Assert(OldFirst[-1].y==-AntInfinity);
         Assert(OldFirst<OldLast);
-        SetPoints(window, OldFirst, OldLast, To);
-        SetPoints(window, BufferFirst+1, antLast, From);
+        To.resize(OldLast-OldFirst);
+        SetPoints(window, OldFirst, OldLast, To.data());
+        SetPoints(window, BufferFirst+1, antLast, From.data());
     }
     const float t = 1.0f*(globalTime-baseTime);
 #if 1   
     // Interpolate current buffer with From
     if (t < 1.0f) {
         const float f = std::min(t, 1.0f);
-        const Point* p = From;
+        const Point* p = From.data();
         for (Ant* a = BufferFirst+1; a!=antLast; ++a, ++p)
             static_cast<Point&>(*a) = f**a + (1.0f-f)**p;
     }
@@ -118,7 +213,7 @@ static Ant* AntCutCompose(NimblePixMap& window, Ant* antLast) {
     if (t<2.0f) {
         // Interpolate old buffer with to 
         const float f = Min(1.0f, 2.0f-t);
-        const Point* p = To;
+        const Point* p = To.data();
         Ant* a = antLast;
         for (Ant* old=OldFirst; old!=OldLast; ++old, ++p) {
             if (!old->isBookend()) {
@@ -150,13 +245,59 @@ static void DrawAnts(NimblePixMap& window, const Ant* antFirst, const Ant* antLa
     }
 }
 
-void Ant::closeBufferAndDraw(NimblePixMap& window, const CompoundRegion& region, Ant* antLast, bool compose, bool showAnts) {
-    if (compose)
+//! Close the buffer that will be drawn within the given CompoundRegion or NimbleRect, and return pointer to one past its last bookend.
+template<typename Region>
+static Ant* CloseBuffer(NimblePixMap& window, const Region& region, Ant* antLast, bool compose) {
+    Assert(BufferFirst<antLast && antLast<=BufferLimit);
+    if (compose) {
+        // Room for the old buffer's Ants and the last bookend
+        antLast = ReserveAnts(antLast, (OldLast-OldFirst)+1);
         antLast = AntCutCompose(window, antLast);
-    Assert(AntArray[CurrentHalf] < antLast && antLast<AntArray[CurrentHalf]+N_ANT_MAX);
+    }
+    if (PersistentAntOrder && BufferCount<N_ORDERED_BUFFER_MAX) {
+        SortByY(BufferFirst+1, antLast, PreviousOrder[BufferCount]);
+        // Culling needs the Ants sorted by y.  Cull after sorting, so that the previous order refers to the whole buffer.
+        if (CullAnts)
+            antLast = CullHiddenAnts(BufferFirst+1, antLast, region);
+    }
+    ++BufferCount;
     (antLast++)->assignLastBookend();
     BufferPtr = antLast;
+    return antLast;
+}
+
+//! Close the buffer and draw it within the given CompoundRegion or NimbleRect.
+template<typename Region>
+static void CloseBufferAndDraw(NimblePixMap& window, const Region& region, Ant* antLast, bool compose, bool showAnts) {
+    antLast = CloseBuffer(window, region, antLast, compose);
     DrawVoronoi(window, region, BufferFirst, antLast);
     if (showAnts)
         DrawAnts(window, BufferFirst+1, antLast-1);
+}
+
+void Ant::closeBufferAndDraw(NimblePixMap& window, const CompoundRegion& region, Ant* antLast, bool compose, bool showAnts) {
+    CloseBufferAndDraw(window, region, antLast, compose, showAnts);
+}
+
+void Ant::closeBufferAndDraw(NimblePixMap& window, const NimbleRect& rect, Ant* antLast, bool compose, bool showAnts) {
+    CloseBufferAndDraw(window, rect, antLast, compose, showAnts);
+}
+
+void Ant::closeBuffer(NimblePixMap& window, const CompoundRegion& region, Ant* antLast, bool compose) {
+    antLast = CloseBuffer(window, region, antLast, compose);
+    const Ant* base = AntArray[CurrentHalf].data();
+    ClosedBuffers.push_back({&region, size_t(BufferFirst-base), size_t(antLast-base)});
+}
+
+void Ant::drawClosedBuffers(NimblePixMap& window, bool showAnts) {
+    static std::vector<VoronoiDiagram> diagrams;
+    diagrams.clear();
+    Ant* base = AntArray[CurrentHalf].data();
+    for (const ClosedBuffer& c: ClosedBuffers)
+        diagrams.push_back({c.region, base+c.first, base+c.last});
+    DrawVoronoi(window, diagrams.data(), diagrams.data()+diagrams.size());
+    if (showAnts)
+        for (const VoronoiDiagram& d: diagrams)
+            DrawAnts(window, d.antFirst+1, d.antLast-1);
+    ClosedBuffers.clear();
 }
\ No newline at end of file
@@ -28,6 +28,13 @@ constexpr float AntInfinity = std::numeric_limits<float>::max();
 //! Display Voronoi seeds if set
 extern bool ShowAnts;
 
+//! If set, sorting a buffer of Ants by y starts from the order found for the same buffer on the previous frame.
+extern bool PersistentAntOrder;
+
+//! If set, closing a buffer drops Ants whose cells cannot reach the region that the buffer is drawn in.
+//! Applies only to buffers sorted with PersistentAntOrder.
+extern bool CullAnts;
+
 //! A Voronoi generator point and its associated interior/exterior colors. 
 //! Also has static members that implement a module for buffering Ants.
 class Ant : public Point {
@@ -64,17 +71,26 @@ public:
         color = color_;
     }
 
-    //! Return a pointer to the beginning of a buffer to be filled with Ants.  
-    static Ant* openBuffer();
+    //! Return a pointer to the beginning of a buffer to be filled with at most n Ants.
+    static Ant* openBuffer(size_t n);
 
     //! Close a buffer and draw the corresponding Voronoi diagram in the given window.
+    //! If PersistentAntOrder is set, an Ant's identity from frame to frame is its position in the order that the
+    //! buffer was filled, and a buffer's identity is how many buffers were closed before it since clearBuffer.
     static void closeBufferAndDraw(NimblePixMap& window, const CompoundRegion& region, Ant* antLast, bool compose=false, bool showAnts=ShowAnts);
 
+    //! Same as the other closeBufferAndDraw, but draws within a rectangle inside the window instead of a CompoundRegion.
+    static void closeBufferAndDraw(NimblePixMap& window, const NimbleRect& rect, Ant* antLast, bool compose=false, bool showAnts=ShowAnts);
+
+    //! Close a buffer, and defer drawing it within the given region until drawClosedBuffers is called.
+    //! The region must not overlap regions of other deferred buffers, and must live until drawClosedBuffers returns.
+    static void closeBuffer(NimblePixMap& window, const CompoundRegion& region, Ant* antLast, bool compose=false);
+
+    //! Draw the buffers deferred by closeBuffer, all in one sweep.
+    static void drawClosedBuffers(NimblePixMap& window, bool showAnts=ShowAnts);
+
     static void clearBuffer();
     static void switchBuffer();
 };
 
-//! Maximum number of Ants in a buffer
-constexpr size_t N_ANT_MAX = 1<<15;
-
 #endif /* Ant_H */
\ No newline at end of file
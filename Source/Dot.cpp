@@ -16,6 +16,7 @@
 #include "Dot.h"
 #include "Enum.h"
 #include "Pond.h"
+#include "Region.h"
 #include "Utility.h"
 #include "World.h"
 #include <algorithm>
@@ -143,7 +144,7 @@ void Dot::initialize(const NimblePixMap& pixmap) {
     DotOf[BeetleKind::predator] = &DotMap[DotKind::cross];
 }
 
-void Dot::draw(NimblePixMap& window, const Pond& p) {
+void Dot::draw(NimblePixMap& window, const Pond& p, const CompoundRegion& region) {
     const int32_t r = DotRadius;
 
     const Point o = World::viewTransform.transform(p.center());
@@ -162,11 +163,12 @@ void Dot::draw(NimblePixMap& window, const Pond& p) {
         const int32_t yo = d.top;
         const int32_t xl = std::max(0, xo);
         const int32_t xr = std::min(window.width(), xo + 2*r + 2);
-        const int32_t yt = std::max(0, yo);
-        const int32_t yb = std::min(window.height(), yo + 2*r + 2);
+        const int32_t yt = std::max({0, yo, region.top()});
+        const int32_t yb = std::min({window.height(), yo + 2*r + 2, region.bottom()});
         for (int32_t y=yt; y<yb; ++y)
-            for (int32_t x=xl; x<xr; ++x)
-                if (image[y-yo][x-xo])
-                    *(NimblePixel*)window.at(x, y) = b.color.interior();
+            for (const RegionSegment* s=region.begin(y); s!=region.end(y); ++s)
+                for (int32_t x=std::max<int32_t>(xl, s->left); x<std::min<int32_t>(xr, s->right); ++x)
+                    if (image[y-yo][x-xo])
+                        *(NimblePixel*)window.at(x, y) = b.color.interior();
     }
 }
\ No newline at end of file
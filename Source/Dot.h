@@ -24,8 +24,8 @@ class Dot {
 public:
     static void initialize(const NimblePixMap& map);
 
-    //! Draw dots for ants in given pond.
-    static void draw(NimblePixMap& window, const Pond& p);
+    //! Draw dots for ants in given pond, clipped to the given region.
+    static void draw(NimblePixMap& window, const Pond& p, const CompoundRegion& region);
 };
 
 #endif /* Dot_H */
@@ -53,4 +53,8 @@ Ant* Finale::copyToAnts(Ant* a, NimblePixMap& window, Point p, Point q) {
         v = Point(0, 0.001f);
     Point o = p+r.intercept(p, v)*0.5f*v;
     return FinaleText.copyToAnts(a, o-0.5f*Point(FinaleText.width(), FinaleText.height()));
+}
+
+size_t Finale::antCountMax() {
+    return FinaleText.antCountMax();
 }
\ No newline at end of file
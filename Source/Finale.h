@@ -30,6 +30,8 @@ public:
         Point p should be a point not on land.
         Point q should be the center of the pond containing p or connected to a bridge containing p. */
     static Ant* copyToAnts(Ant* a, NimblePixMap& window, Point p, Point q);
+    //! Upper bound on number of Ants that copyToAnts generates.
+    static size_t antCountMax();
 private:
     static float myTime;
 };
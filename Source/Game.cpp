@@ -22,6 +22,7 @@
 #include "Host.h"
 #include "Missile.h"
 #include "NimbleDraw.h"
+#include "Parallel.h"
 #include "Pond.h"
 #include "Self.h"
 #include "Sound.h"
@@ -29,11 +30,13 @@
 #include "Synthesizer.h"
 #include "Utility.h"
 #include "Vanity.h"
+#include "Voronoi.h"
 #include "VoronoiText.h"
 #include "Widget.h"
 #include "World.h"
 
 #include <cctype>
+#include <cstdio>
 #include <cstdlib>
 #include <cmath>
 #include <algorithm>
@@ -200,6 +203,41 @@ static void Draw(NimblePixMap& screen) {
     }
 }
 
+#if WIZARD_ALLOWED
+//! File that per-frame rasterizer counts are logged to, or nullptr if not logging.
+static FILE* VoronoiStatsFile;
+
+//! Histogram of per-frame rasterizer counts logged since logging started.
+static VoronoiStatsHistogram VoronoiStatsFrames;
+
+//! Start or stop logging of rasterizer counts.  When stopped, the histogram is written too.
+static void ToggleVoronoiStatsLog() {
+    if (!VoronoiStatsFile) {
+        VoronoiStatsFile = std::fopen("voronoi-stats.csv", "w");
+        if (VoronoiStatsFile) {
+            VoronoiStats::writeCsvHeader(VoronoiStatsFile);
+            VoronoiStatsFrames.clear();
+        }
+    } else {
+        std::fclose(VoronoiStatsFile);
+        VoronoiStatsFile = nullptr;
+        if (FILE* f = std::fopen("voronoi-histogram.csv", "w")) {
+            VoronoiStatsFrames.writeCsv(f);
+            std::fclose(f);
+        }
+    }
+}
+
+//! Log rasterizer counts of the frame just drawn, if logging.
+static void LogVoronoiStats() {
+    const VoronoiStats s = TakeVoronoiFrameStats();
+    if (VoronoiStatsFile) {
+        s.writeCsv(VoronoiStatsFile);
+        VoronoiStatsFrames.add(s);
+    }
+}
+#endif
+
 static bool InitWorldFlag = false;
 
 void GameUpdateDraw(NimblePixMap& screen, NimbleRequest request) {
@@ -217,6 +255,9 @@ void GameUpdateDraw(NimblePixMap& screen, NimbleRequest request) {
         screen.draw(NimbleRect(0, 0, screen.width(), screen.height()), NimblePixel(-1));
 #endif
         Draw(screen);
+#if WIZARD_ALLOWED
+        LogVoronoiStats();
+#endif
     }
 }
 
@@ -257,6 +298,21 @@ void GameKeyDown(int key) {
             HostSetFrameIntervalRate(frameIntervalRate);
             break;
         }
+        case 'c':
+            // Toggle between drawing on one core and all cores.
+            if (IsWizard)
+                SetWorkerCount(WorkerCount()==1 ? 0 : 1);
+            break;
+        case 'r':
+            // Toggle logging of rasterizer counts.
+            if (IsWizard)
+                ToggleVoronoiStatsLog();
+            break;
+        case 'e':
+            // Toggle adaptive resolution of the ponds view.
+            if (IsWizard)
+                AdaptiveResolution = !AdaptiveResolution;
+            break;
 #endif
 #if WIZARD_ALLOWED
 #if 0 /* Need different letter */
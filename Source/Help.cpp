@@ -46,11 +46,9 @@ static InkOverlay TheHelp[2] = {"Help.934x633.png","Help.1867x1265.png"};
 
 void Help::draw(NimblePixMap& window) {
     // Draw background
-    CompoundRegion region;
-    region.buildRectangle(Point(0, 0), Point(window.width(), window.height()));
-    Ant* a = Ant::openBuffer();
+    Ant* a = Ant::openBuffer(HelpBackground.size());
     a = HelpBackground.copyToAnts(a, HelpViewTransform);
-    Ant::closeBufferAndDraw(window, region, a, true);
+    Ant::closeBufferAndDraw(window, NimbleRect(0, 0, window.width(), window.height()), a, true);
 
     // Find biggest available help overlay that fits screen.
     auto* h= TheHelp + 1;
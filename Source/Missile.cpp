@@ -87,6 +87,10 @@ Ant* Missiles::copyToAnts(Ant* a, size_t firstPond, size_t lastPond) {
     return a;
 }
 
+size_t Missiles::antCountMax() {
+    return N_Missile;
+}
+
 void Missiles::tryFire() {
     if (Self.isAlive() && TheScoreMeter.missileCount()>0)
         for (size_t k=0; k<N_Missile; ++k)
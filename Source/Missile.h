@@ -29,6 +29,8 @@ public:
     static void tallyHit(Beetle& b);
     //! Fill Ant buffer with Ants for any Missiles in ponds [firstPond,lastPond)
     static Ant* copyToAnts(Ant* a, size_t firstPond, size_t lastPond);
+    //! Upper bound on number of Ants that copyToAnts generates.
+    static size_t antCountMax();
 };
 
 #endif /* Missile_H */
\ No newline at end of file
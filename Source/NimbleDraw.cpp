@@ -21,6 +21,7 @@
 #include "NimbleDraw.h"
 #include "Utility.h"
 #include <cstring>
+#include <vector>
 
 NimbleColor NimblePixMap::color(NimblePixel p) const {
 #if NIMBLE_MAC
@@ -156,6 +157,33 @@ void NimblePixMap::drawOn(NimblePixMap& dst, int x, int y) const {
     }
 }
 
+void NimblePixMap::drawScaledOn(NimblePixMap& dst) const {
+    Assert(dst.lgBitPixelDepth()==lgBitPixelDepth());
+    const int w = dst.width();
+    const int h = dst.height();
+    if (w<=0 || h<=0 || width()<=0 || height()<=0)
+        return;
+    // Source column for each destination column
+    static std::vector<int32_t> column;
+    column.resize(w);
+    for (int j=0; j<w; ++j)
+        column[j] = int32_t(int64_t(j)*width()/w);
+    int previous = -1;
+    for (int i=0; i<h; ++i) {
+        const int k = int(int64_t(i)*height()/h);
+        NimblePixel* d = (NimblePixel*)dst.at(0, i);
+        if (k==previous) {
+            // Same source row as the destination row above
+            std::memcpy(d, dst.at(0, i-1), w*sizeof(NimblePixel));
+        } else {
+            const NimblePixel* s = (const NimblePixel*)at(0, k);
+            for (int j=0; j<w; ++j)
+                d[j] = s[column[j]];
+            previous = k;
+        }
+    }
+}
+
 NimblePixel NimblePixMap::interpolatePixelAt(float x, float y) {
     Assert(0<=x);
     Assert(0<=y);
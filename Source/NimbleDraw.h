@@ -210,6 +210,9 @@ public:
     //! Draw this map onto dst.
     void drawOn(NimblePixMap& dst, int32_t x, int32_t y) const;
 
+    //! Draw this map stretched to cover all of dst, using the nearest pixel.
+    void drawScaledOn(NimblePixMap& dst) const;
+
     //! Move base address by ammount corresponding to given deltaX and deltaY
     void shift(int32_t deltaX, int32_t deltaY);
 
@@ -17,16 +17,108 @@
 #include "Utility.h"
 #include "Config.h"
 #include <algorithm>
+#include <climits>
 #include <cmath>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <type_traits>
+#include <vector>
 
 uint32_t OutlinedColor::exteriorColorCount;
 NimblePixel OutlinedColor::exteriorTable[OutlinedColor::exteriorNumColorMax+1];
 
 uint32_t Outline::idCount;
+size_t Outline::growthCount;
+Outline::Stats Outline::lastStatsValue, Outline::highWaterValue;
+float Outline::widthValue = Outline::lineWidth;
+uint32_t Outline::widthGeneration;
+
+Outline::Stripe Outline::stripeArray[Outline::nStripeMax];
+size_t Outline::stripeCount;
+
+void Outline::start(size_t nStripe, size_t maxId) {
+    Assert(0<nStripe && nStripe<=nStripeMax);
+    Assert(maxId<UINT32_MAX);
+    stripeCount = nStripe;
+    idCount = uint32_t(maxId);
+    growthCount = 0;
+    if (binCount.size()<=maxId) {
+        // New elements of binCount are zero, as sortIntoBins requires.
+        const size_t n = Max(maxId+1, 2*binCount.size());
+        binCount.resize(n, 0);
+        binPtr.resize(n);
+        ++growthCount;
+    }
+    for (size_t k=0; k<nStripe; ++k) {
+        Stripe& t = stripeArray[k];
+        if (t.myArray.empty())
+            t.myArray.resize(nSegmentInitial);
+        t.myPtr = t.myArray.data();
+        t.myLimit = t.myArray.data()+t.myArray.size();
+        t.myGrowthCount = 0;
+    }
+    // Initialize sentinel
+    Stripe& t = stripeArray[0];
+    t.myPtr->id = idType::null;
+    ++t.myPtr;
+}
+
+void Outline::Stripe::grow() {
+    const size_t n = myPtr-myArray.data();
+    myArray.resize(2*myArray.size());
+    myPtr = myArray.data()+n;
+    myLimit = myArray.data()+myArray.size();
+    ++myGrowthCount;
+}
+
+namespace {
+
+const int cacheSize = (Outline::lineWidth+1)*(Outline::lineWidth+1)+2;
+
+//! Interpolation weights for each squared distance in a ramp.
+/** Entry d2 blends fraction frac[d2] of the interior color with fraction 1-frac[d2] of the exterior color. */
+struct FractionTable {
+    float frac[cacheSize];
+    float oneMinusFrac[cacheSize];
+    FractionTable() {
+        build(Outline::lineWidth);
+    }
+    //! Set the weights for an outline of the given width.  Distances beyond the width get the interior color.
+    void build(float width) {
+        for (int d2=0; d2<cacheSize; ++d2) {
+            frac[d2] = Min(1.0f, (std::sqrt(float(d2))-1)*(1.0f/width));
+            oneMinusFrac[d2] = 1.f-frac[d2];
+        }
+    }
+};
 
-Outline::segment Outline::array[Outline::nSegmentMax];
-Outline::segment* Outline::ptr = Outline::array;
+FractionTable TheFractionTable;
 
+//! Colors for a cell, indexed by squared distance from the nearest pixel outside the cell.
+/** Indices 0 and 1 are the exterior color.  Index cacheSize-1 is the interior color. */
+struct Ramp {
+    NimblePixel color[cacheSize];
+};
+
+#if defined(_M_X64) || defined(__SSE2__)
+//! Set the blended entries of the ramp, doing the red, green, and blue channels together.
+void BuildRamp(Ramp& ramp, NimblePixel interior, NimblePixel exterior) {
+    const __m128i zero = _mm_setzero_si128();
+    auto unpack = [&](NimblePixel c) {
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(int(c&0xFFFFFF)), zero), zero));
+    };
+    const __m128 a = unpack(exterior);
+    const __m128 b = unpack(interior);
+    for (int d2=2; d2<cacheSize-1; ++d2) {
+        // Same operations in the same order as the scalar version, so that the results are identical.
+        const __m128 c = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(TheFractionTable.oneMinusFrac[d2]), a),
+                                    _mm_mul_ps(_mm_set1_ps(TheFractionTable.frac[d2]), b));
+        const __m128i i = _mm_cvttps_epi32(c);
+        ramp.color[d2] = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(i, zero), zero));
+    }
+}
+#else
 inline int Red(NimblePixel c) {
     return c>>16&0xFF;
 }
@@ -39,189 +131,311 @@ inline int Blue(NimblePixel c) {
     return c>>0&0xFF;
 }
 
-inline int InterpolateInt(float frac, int a, int b) {
-    return (1.f-frac)*a + frac*b;
+inline int InterpolateInt(int d2, int a, int b) {
+    return TheFractionTable.oneMinusFrac[d2]*a + TheFractionTable.frac[d2]*b;
 }
 
-// FIXME - consider using SSE
-inline NimblePixel InterpolateColor(float frac, NimblePixel c0, NimblePixel c1) {
-    return InterpolateInt(frac, Red(c0), Red(c1))<<16 |
-        InterpolateInt(frac, Green(c0), Green(c1))<<8 |
-        InterpolateInt(frac, Blue(c0), Blue(c1));
+//! Set the blended entries of the ramp.
+void BuildRamp(Ramp& ramp, NimblePixel interior, NimblePixel exterior) {
+    for (int d2=2; d2<cacheSize-1; ++d2)
+        ramp.color[d2] = InterpolateInt(d2, Red(exterior), Red(interior))<<16 |
+            InterpolateInt(d2, Green(exterior), Green(interior))<<8 |
+            InterpolateInt(d2, Blue(exterior), Blue(interior));
 }
+#endif
 
-const int cacheSize = (Outline::lineWidth+1)*(Outline::lineWidth+1)+2;
-static NimblePixel interiorCache, exteriorCache, cache[cacheSize];
-
-void Outline::loadCache(NimblePixel interior, NimblePixel exterior) {
-    if (cache[0]!=exterior || cache[(lineWidth+1)*(lineWidth+1)+1] != interior) {
-        cache[0] = cache[1] = exterior;
-        for (int d2=2; d2<=(lineWidth+1)*(lineWidth+1); ++d2) {
-            float f = (std::sqrt(float(d2))-1)*(1.0f/lineWidth);
-            cache[d2] = InterpolateColor(f, exterior, interior);
+//! Set-associative cache of ramps, keyed by interior and exterior color, with least-recently-used replacement.
+/** Colors wobble from frame to frame, but many cells repeat a pair seen recently. */
+class RampCache {
+    static const int nSet = 64;
+    static const int nWay = 4;
+    struct key {
+        NimblePixel interior, exterior;
+        //! Value of myClock when the entry was last used
+        uint32_t lastUse;
+    };
+    //! Zero-initialized entries hold the all-zero ramp, which is the correct ramp for the key (0,0).
+    key myKey[nSet][nWay] = {};
+    Ramp myRamp[nSet][nWay] = {};
+    uint32_t myClock = 0;
+    static unsigned setOf(NimblePixel interior, NimblePixel exterior) {
+        return (interior*0x9E3779B1u ^ exterior*0x85EBCA77u)>>26;
+    }
+public:
+    //! Get the ramp for the given colors.  The pointer is valid until the next call.
+    const NimblePixel* find(NimblePixel interior, NimblePixel exterior);
+    //! Discard all ramps, because the fraction table changed.
+    void clear() {
+        std::fill(myKey[0], myKey[0]+nSet*nWay, key{});
+        std::fill(myRamp[0], myRamp[0]+nSet*nWay, Ramp{});
+    }
+};
+
+const NimblePixel* RampCache::find(NimblePixel interior, NimblePixel exterior) {
+    static_assert(nSet==1<<(32-26), "setOf assumes nSet==64");
+    const unsigned s = setOf(interior, exterior);
+    key* k = myKey[s];
+    ++myClock;
+    int victim = 0;
+    for (int w=0; w<nWay; ++w) {
+        if (k[w].interior==interior && k[w].exterior==exterior) {
+            k[w].lastUse = myClock;
+            return myRamp[s][w].color;
         }
-        cache[(lineWidth+1)*(lineWidth+1)+1] = interior;
+        // Unsigned difference handles wraparound of the clock.
+        if (myClock-k[w].lastUse > myClock-k[victim].lastUse)
+            victim = w;
     }
+    k[victim] = {interior, exterior, myClock};
+    Ramp& r = myRamp[s][victim];
+    r.color[0] = r.color[1] = exterior;
+    BuildRamp(r, interior, exterior);
+    r.color[cacheSize-1] = interior;
+    return r.color;
 }
 
-template<bool Left, bool Right>
-void Outline::gradient(const segment* s, const segment* jmin, const segment* jmax, int xleft, int xright, NimblePixel* out) {
-    Assert(jmin[0].id==s->id);
-    Assert(jmax[0].id==s->id);
-    Assert(jmin<=s);
-    Assert(s<=jmax);
-    Assert(!(Left && Right));
-    Assert(0<=xleft);
-    Assert(jmin[0].y<=s->y && s->y<=jmax[0].y);
-    const int y = s->y;
-    int mind2init = Min<int>(Square(1+Min(y-jmin[0].y, jmax[0].y-y)), cacheSize-1);
-    if (Left) {
-        // Trim search region
-        while (jmin<s && jmin[0].left<=s[0].left)
-            ++jmin;
-        while (jmax>s && jmax[0].left<=s[0].left)
-            --jmax;
-        if (xleft==s->left)
-            out[xleft++] = cache[1];
-    }
-    if (Right) {
-        // Trim search region
-        while (jmin<s && jmin[0].right>=s[0].right)
-            ++jmin;
-        while (jmax>s && jmax[0].right>=s[0].right)
-            --jmax;
-        if (xright==s->right)
-            out[--xright] = cache[1];
-    }
-    for (int x=xleft; x<xright; ++x) {
-        int mind2 = mind2init;
-        for (const segment* j=jmin; ; ++j) {
-            int dy = j[0].y-y;
-            int d2 = dy*dy;
-            if (Left) {
-                if (x>=j[0].left) {
-                    int dx = x-(j[0].left-1);
-                    d2 += dx*dx;
+//! Distances of cap or more all map to the interior color, so drawCell clips distances to cap.
+constexpr int cap = Outline::lineWidth+2;
+static_assert(cap*cap>=cacheSize-1, "cap too small");
+//! Squared distances are kept in the narrowest type that holds them, so that the loops use wide vector instructions.
+using distType = std::conditional<2*cap*cap<=UINT8_MAX, uint8_t, uint16_t>::type;
+
+} // (anonymous)
+
+//! Ramps and scratch space for drawing one chunk of cells.  Chunks are drawn concurrently, so each has its own.
+struct Outline::worker {
+    RampCache ramps;
+    //! Value of widthGeneration when ramps were last valid.
+    uint32_t rampGeneration = 0;
+    std::vector<distType> grid;
+    std::vector<int> solidLeft, solidRight;
+    std::vector<distType> dist2;
+};
+
+std::unique_ptr<Outline::worker> Outline::workerArray[Outline::nStripeMax];
+
+void Outline::drawCell(NimblePixMap& window, const NimblePixel* ramp, const segment* first, const segment* last, worker& w) {
+    Assert(first<last);
+    // Segments are sorted by y.
+    const int top = first->y;
+    const int bottom = last[-1].y+1;
+    if (bottom<=0 || top>=window.height())
+        return;
+    int left = first->left;
+    int right = first->right;
+    for (const segment* s=first+1; s<last; ++s) {
+        left = Min(left, +s->left);
+        right = Max(right, +s->right);
+    }
+    // First pass: square of horizontal distance from each pixel to the nearest outside pixel in its row.
+    // Grid point (i,j) corresponds to pixel (left+i,top-1+j).  The first and last rows are outside the cell.
+    const int width = right-left;
+    const int h = bottom-top+2;
+    std::vector<distType>& grid = w.grid;
+    grid.assign(size_t(width)*h, 0);
+    // For rows with a single segment, [solidLeft,solidRight) is the segment.  Other rows have an empty interval.
+    constexpr int none = INT_MAX/2;
+    std::vector<int>& solidLeft = w.solidLeft;
+    std::vector<int>& solidRight = w.solidRight;
+    solidLeft.assign(h, none);
+    solidRight.assign(h, -none);
+    for (const segment* s=first; s<last; ++s) {
+        const int j = s->y-top+1;
+        distType* g = grid.data()+size_t(j)*width;
+        // Pixels s->left-1 and s->right are outside, so pixels in [s->left+cap-1,s->right-cap] are at least cap from them.
+        const int xl = Min(s->left+cap-1, +s->right);
+        const int xr = Max(s->right-cap+1, xl);
+        for (int x=s->left; x<xl; ++x)
+            g[x-left] = Min(cap, Min(x-(s->left-1), s->right-x))*Min(cap, Min(x-(s->left-1), s->right-x));
+        std::fill(g+(xl-left), g+(xr-left), distType(cap*cap));
+        for (int x=xr; x<s->right; ++x)
+            g[x-left] = Min(cap, s->right-x)*Min(cap, s->right-x);
+        if (solidLeft[j]==none) {
+            solidLeft[j] = s->left;
+            solidRight[j] = s->right;
+        } else {
+            solidRight[j] = -none;
+        }
+    }
+
+    // Second pass: for each row in the window, the minimum over nearby rows of the square of vertical distance plus
+    // the first pass's result.  Rows farther than cap contribute only distances that map to the interior color.
+    std::vector<distType>& dist2 = w.dist2;
+    dist2.resize(width);
+    for (const segment* s=first; s<last; ) {
+        const int y = s->y;
+        const segment* e = s;
+        int rowLeft = s->left;
+        int rowRight = s->right;
+        for (; e<last && e->y==y; ++e) {
+            rowLeft = Min(rowLeft, +e->left);
+            rowRight = Max(rowRight, +e->right);
+        }
+        if (unsigned(y)<unsigned(window.height())) {
+            const int j = y-top+1;
+            // Find [interiorLeft,interiorRight), where every row within cap-1 is a single segment that reaches at least
+            // cap beyond, so that the pixels are of interior color.
+            int interiorLeft = rowLeft;
+            int interiorRight = rowLeft;
+            if (cap-1<=j && j+cap-1<h) {
+                int l = -none;
+                int r = none;
+                for (int k=j-cap+1; k<j+cap; ++k) {
+                    l = Max(l, solidLeft[k]);
+                    r = Min(r, solidRight[k]);
                 }
-            } else if (Right) {
-                if (x<j[0].right) {
-                    int dx = x-j[0].right;
-                    d2 += dx*dx;
+                if (l+cap-1<r-cap+1) {
+                    interiorLeft = l+cap-1;
+                    interiorRight = r-cap+1;
                 }
-            } else {
-                if (x<j[0].left) {
-                    if (j[-1].y==j[0].y && j[-1].id==j[0].id && x<j[-1].right)
-                        goto next;
-                } else if (x>=j[0].right) {
-                    if (j[1].y==j[0].y && j[1].id==j[0].id && x>=j[1].left)
-                        goto next;
-                } else {
-                    int m2 = (j[0].left-1)+j[0].right;
-                    int dx;
-                    if (2*x<m2) dx = x-(j[0].left-1);
-                    else dx = x-j[0].right;
-                    d2 += dx*dx;
+            }
+            // Compute squared distances in [rowLeft,interiorLeft) and [interiorRight,rowRight).
+            for (int part=0; part<2; ++part) {
+                const int i0 = (part==0 ? rowLeft : interiorRight)-left;
+                const int n = (part==0 ? interiorLeft : rowRight)-left-i0;
+                distType* d = dist2.data()+i0;
+                std::copy_n(grid.data()+size_t(j)*width+i0, n, d);
+                for (int dy=1; dy<cap; ++dy) {
+                    const distType dy2 = dy*dy;
+                    if (j-dy>=0) {
+                        const distType* g = grid.data()+size_t(j-dy)*width+i0;
+                        for (int k=0; k<n; ++k)
+                            d[k] = Min<distType>(d[k], g[k]+dy2);
+                    }
+                    if (j+dy<h) {
+                        const distType* g = grid.data()+size_t(j+dy)*width+i0;
+                        for (int k=0; k<n; ++k)
+                            d[k] = Min<distType>(d[k], g[k]+dy2);
+                    }
                 }
             }
-            if (d2<mind2)
-                mind2=d2;
-next:
-            if (j==jmax) break;
+            const NimblePixel interior = ramp[cacheSize-1];
+            NimblePixel* out = (NimblePixel*)window.at(0, y);
+            auto shade = [&](int x0, int x1) {
+                for (int x=x0; x<x1; ++x)
+                    out[x] = ramp[Min<int>(dist2[x-left], cacheSize-1)];
+            };
+            for (; s<e; ++s) {
+                const int x0 = Max<int>(s->left, 0);
+                const int x1 = Min<int>(s->right, window.width());
+                shade(x0, Min(x1, interiorLeft));
+                for (int x=Max(x0, interiorLeft), xEnd=Min(x1, interiorRight); x<xEnd; ++x)
+                    out[x] = interior;
+                shade(Max(x0, interiorRight), x1);
+            }
         }
-        out[x] = cache[mind2];
-#if 0
-        out[x] = Left && Right ? 0xFFFFFF : Left ? 0xFF0000 : Right ? 0x0000FF : 0;
-#endif
+        s = e;
     }
 }
 
-Outline::segment Outline::sorted[nSegmentMax];
+SimpleArray<Outline::segment> Outline::sorted;
+std::vector<uint32_t> Outline::binCount;
+std::vector<Outline::segment*> Outline::binPtr;
 
 Outline::segment* Outline::sortIntoBins() {
-    static uint32_t binCount[nIdMax];
-    static segment* binPtr[nIdMax];
-
 #if ASSERTIONS
     for (unsigned i=0; i<=idCount; ++i)
         Assert(binCount[i]==0);
 #endif
-    for (const segment* s = array; s<ptr; ++s) {
-        const uint32_t i = static_cast<uint32_t>(s->id);
-        Assert(i < nIdMax);
-        binCount[i]++;
+    size_t n = 0;
+    for (size_t k=0; k<stripeCount; ++k) {
+        const Stripe& t = stripeArray[k];
+        for (const segment* s = t.myArray.data(); s<t.myPtr; ++s) {
+            const uint32_t i = static_cast<uint32_t>(s->id);
+            Assert(i <= idCount);
+            binCount[i]++;
+        }
+        n += t.myPtr-t.myArray.data();
+    }
+    // Extra element is for the sentinel written by finishAndDraw
+    if (sorted.size()<n+1) {
+        sorted.resize(Max<size_t>(n+1, 2*sorted.size()));
+        ++growthCount;
     }
-    segment* total = sorted;
+    segment* total = sorted.begin();
     for (uint32_t i=0; i<=idCount; ++i) {
         binPtr[i] = total;
         total += binCount[i];
         binCount[i] = 0;        // Clear for next time around
     }
-    Assert(total-sorted == ptr-array);
-    for (const segment* s = array; s<ptr; ++s) {
-        const uint32_t i = static_cast<uint32_t>(s->id);
-        Assert(sorted<=binPtr[i] && binPtr[i]<sorted+nSegmentMax);
-        *binPtr[i]++ = *s;
-    }
-    Assert(binPtr[idCount]-sorted == ptr-array);
-#if 0
-    static int maxBinCount, maxIdCount;
-    maxIdCount = Max<int>(maxIdCount, idCount);
-    maxBinCount = Max<int>(maxBinCount, ptr-array);
-#endif
+    Assert(size_t(total-sorted.begin()) == n);
+    // Stripes are visited in order, so within each bin the segments remain sorted by y.
+    for (size_t k=0; k<stripeCount; ++k) {
+        const Stripe& t = stripeArray[k];
+        for (const segment* s = t.myArray.data(); s<t.myPtr; ++s) {
+            const uint32_t i = static_cast<uint32_t>(s->id);
+            Assert(sorted.begin()<=binPtr[i] && binPtr[i]<sorted.begin()+n);
+            *binPtr[i]++ = *s;
+        }
+    }
+    Assert(size_t(binPtr[idCount]-sorted.begin()) == n);
     return binPtr[idCount];
 }
 
+void Outline::setWidth(float w) {
+    Assert(0<w && w<=lineWidth);
+    if (w!=widthValue) {
+        widthValue = w;
+        TheFractionTable.build(w);
+        ++widthGeneration;
+    }
+}
+
 void Outline::finishAndDraw(NimblePixMap& window) {
     // FIXME - consider using radix sort
     segment* sortedEnd = sortIntoBins();
     sortedEnd->id = idType::null;
 
-    int prevId = 0;
-    for (const segment* s = sorted+1; s<sortedEnd; ++s) {
-        if (unsigned(s->y)>=unsigned(window.height()))
-            continue;
-        Assert(s->color.hasExterior());
-        const int x0 = Max<int>(s->left, 0);
-        const int x1 = Min<int>(s->right, window.width());
-        const segment* jmin = s;
-        while (jmin[-1].id==s->id && jmin[-1].y>=s->y-lineWidth)
-            --jmin;
-        const segment* jmax = s;
-        while (jmax[1].id==s->id && jmax[1].y<=s->y+lineWidth)
-            ++jmax;
-        int d = Min(jmax[0].y-s->y, s->y-jmin[0].y);
-        // Now set xleft and xright to bounds of segment that is all of interior color
-        int xleft = s->left;
-        int xright = s->right;
-        if (d>=lineWidth) {
-            for (const segment* j=jmin; j<=jmax; ++j) {
-                xleft = Max(xleft, +j[0].left);
-                xright = Min(xright, +j[0].right);
-            }
-            xleft += lineWidth;
-            xright -= lineWidth;
-            Assert(xleft>=0);
-            if (xleft>=xright)
-                goto empty;
-        } else {
-empty:
-            // Homogeneous part is empty.  Put empty homogeneous part to right of left inhomogeneous part.
-            xleft = xright = s->right;
+    Stats& last = lastStatsValue;
+    // Do not count the sentinel.
+    last.segments = sortedEnd-sorted.begin()-1;
+    last.ids = idCount;
+    last.growths = growthCount;
+    for (size_t k=0; k<stripeCount; ++k)
+        last.growths += stripeArray[k].myGrowthCount;
+    highWaterValue.segments = Max(highWaterValue.segments, last.segments);
+    highWaterValue.ids = Max(highWaterValue.ids, last.ids);
+    highWaterValue.growths = Max(highWaterValue.growths, last.growths);
+
+    // Split the cells into chunks with about the same number of segments.  Cells do not overlap, so chunks write
+    // disjoint pixels and can be drawn concurrently.  Each chunk k uses workerArray[k].
+    const segment* const first = sorted.begin()+1;
+    const size_t nChunk = Min<size_t>(WorkerCount(), 1+last.segments/minSegmentsPerChunk);
+    const segment* chunkFirst[nStripeMax+1];
+    chunkFirst[0] = first;
+    for (size_t k=1; k<nChunk; ++k) {
+        // Move the split forward so that it does not divide a cell.
+        const segment* s = Max(first+last.segments*k/nChunk, chunkFirst[k-1]);
+        while (s<sortedEnd && s!=first && s->id==s[-1].id)
+            ++s;
+        chunkFirst[k] = s;
+    }
+    chunkFirst[nChunk] = sortedEnd;
+    for (size_t k=0; k<nChunk; ++k)
+        if (!workerArray[k])
+            workerArray[k].reset(new worker);
+    auto drawChunk = [&](size_t k) {
+        worker& w = *workerArray[k];
+        if (w.rampGeneration!=widthGeneration) {
+            w.ramps.clear();
+            w.rampGeneration = widthGeneration;
         }
-        NimblePixel c = s->color.interior();
-        loadCache(c, s->color.exterior());
-        NimblePixel* out = (NimblePixel*)window.at(0, s->y);
-        if (xleft<xright) {
-            gradient<true, false>(s, jmin, jmax, x0, xleft, out);
-            // Do homogeneous part
-            for (int x=xleft; x<xright; ++x)
-                out[x] = c;
-            gradient<false, true>(s, jmin, jmax, Max(xright, 0), x1, out);
-        } else {
-            gradient<false, false>(s, jmin, jmax, x0, x1, out);
+        for (const segment* s = chunkFirst[k]; s<chunkFirst[k+1]; ) {
+            // Segments of a cell are contiguous, and all have the same color.
+            const segment* e = s+1;
+            while (e->id==s->id)
+                ++e;
+            Assert(s->color.hasExterior());
+            drawCell(window, w.ramps.find(s->color.interior(), s->color.exterior()), s, e, w);
+            s = e;
         }
-    }
+    };
+    if (nChunk==1)
+        drawChunk(0);
+    else
+        ParallelFor(nChunk, drawChunk);
 #if ASSERTIONS
-    ptr = nullptr;
+    for (size_t k=0; k<stripeCount; ++k)
+        stripeArray[k].myPtr = nullptr;
 #endif
 }
\ No newline at end of file
@@ -18,7 +18,11 @@
 
 #include "AssertLib.h"
 #include "NimbleDraw.h"
+#include "Parallel.h"
+#include "Utility.h"
 #include <cstdint>
+#include <memory>
+#include <vector>
 
  //! Compact representation of a 24-bit interior and 8-bit indexed exterior color.
 class OutlinedColor {
@@ -64,11 +68,19 @@ public:
 
 class Outline {
 public:
-    enum class idType : uint16_t {
+    enum class idType : uint32_t {
         null = 0
     };
+
+    //! Counts for one diagram, from start() through finishAndDraw().
+    struct Stats {
+        size_t segments;    //!< Segments collected
+        size_t ids;         //!< Maximum id passed to start()
+        size_t growths;     //!< Number of times that storage was enlarged
+    };
 private:
-    static const size_t nSegmentMax = 1<<15;
+    //! Initial number of segments that a stripe can hold.  Stripes grow as needed.
+    static const size_t nSegmentInitial = 1<<12;
 
     //! Horizontal segment on display
     struct segment {
@@ -81,41 +93,94 @@ private:
         }
     };
 
-    static segment* ptr;
-    static segment array[nSegmentMax];
-
-    static const size_t nIdMax = 1<<12; // FIXME - determine sensible value
-    static segment sorted[nSegmentMax];
+    static SimpleArray<segment> sorted;
+    //! binCount[i] is number of segments with id i.  All zero between calls to finishAndDraw.
+    static std::vector<uint32_t> binCount;
+    static std::vector<segment*> binPtr;
     static segment* sortIntoBins();
 
-    static void loadCache(NimblePixel interior, NimblePixel exterior);
-    template<bool Left, bool Right>
-    static void gradient(const segment* s, const segment* jmin, const segment* jmax, int xleft, int xright, NimblePixel* out);
+    //! Ramps and scratch space for drawing one chunk of cells.
+    struct worker;
+    //! Draw the cell whose segments are [first,last), shading each pixel by its distance from the nearest pixel outside the cell.
+    //! ramp[d2] is the color for a squared distance of d2.
+    static void drawCell(NimblePixMap& window, const NimblePixel* ramp, const segment* first, const segment* last, worker& w);
+    //! Diagrams with fewer segments than this per worker are drawn with fewer workers.
+    static const size_t minSegmentsPerChunk = 1024;
     static unsigned idCount;
+    //! Times that sorted or the bins were enlarged since start().  Growth of stripes is counted by the stripes.
+    static size_t growthCount;
+    static Stats lastStatsValue, highWaterValue;
+    static float widthValue;
+    //! Incremented when widthValue changes, so that workers know to discard their ramps.
+    static uint32_t widthGeneration;
 public:
+    //! Maximum width of an outline.  It sizes the margins of Region arrays.
     static const int lineWidth = 5;
-    static idType newId() {
-        Assert(idCount+1 < nIdMax);
-        return static_cast<idType>(++idCount);
-    }
-    static void start() {
-        array[0].id = idType::null;    // Initialize sentinel
-        ptr = &array[1];
-        idCount = 0;
-    }
-    static void addSegment(idType id, short left, short right, short y, const OutlinedColor& color) {
-        Assert(color.hasExterior());
-        Assert(ptr<&array[nSegmentMax-1]);
-        if (ptr<&array[nSegmentMax-1]) {
-            segment* s = ptr++;
+
+    //! Width in pixels over which an outline blends from its exterior color to its interior color.
+    static float width() { return widthValue; }
+
+    //! Set width() to w, which must be in (0,lineWidth].  Must not be called while drawing.
+    static void setWidth(float w);
+
+    //! Segments recorded by one horizontal stripe of a diagram.
+    //! Different stripes can be filled concurrently.
+    class Stripe : NoCopy {
+        segment* myPtr;
+        segment* myLimit;
+        std::vector<segment> myArray;
+        //! Times that myArray was enlarged since start().
+        size_t myGrowthCount;
+        //! Enlarge myArray, keeping the segments collected so far.
+        void grow();
+        friend class Outline;
+    public:
+        void addSegment(idType id, short left, short right, short y, const OutlinedColor& color) {
+            Assert(color.hasExterior());
+            Assert(static_cast<unsigned>(id) <= idCount);
+            Assert(myPtr<=myLimit);
+            if (myPtr==myLimit)
+                grow();
+            segment* s = myPtr++;
             s->id = id;
             s->y = y;
             s->left = left;
             s->right = right;
             s->color = color;
         }
+    };
+
+    //! Maximum number of stripes
+    static const size_t nStripeMax = N_WORKER_MAX;
+
+    //! Id of the cell for the Ant with the given index in the buffer passed to DrawVoronoi.
+    static idType idOfAnt(size_t index) {
+        Assert(0<index && index<=idCount);
+        return static_cast<idType>(index);
+    }
+
+    //! Start collecting segments for a diagram that is split into nStripe stripes and has ids in [1,maxId].
+    static void start(size_t nStripe, size_t maxId);
+
+    //! Get kth stripe.  Only stripes below the count passed to start() may be filled.
+    static Stripe& stripe(size_t k) {
+        Assert(k<nStripeMax);
+        return stripeArray[k];
     }
+
+    //! Draw the collected segments.  Stripes must have been filled in top-to-bottom order of their scan lines.
     static void finishAndDraw(NimblePixMap& window);
+
+    //! Counts for the most recent call to finishAndDraw.
+    static const Stats& lastStats() { return lastStatsValue; }
+
+    //! Maximum of each count over all calls to finishAndDraw so far.
+    static const Stats& highWater() { return highWaterValue; }
+private:
+    static Stripe stripeArray[nStripeMax];
+    static size_t stripeCount;
+    //! Workers for the chunks of finishAndDraw.  Allocated on first use.
+    static std::unique_ptr<worker> workerArray[nStripeMax];
 };
 
 #endif /* Outline_H */
\ No newline at end of file
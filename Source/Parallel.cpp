@@ -0,0 +1,124 @@
+/* Copyright 2011-2021 Arch D. Robison
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "Parallel.h"
+#include "AssertLib.h"
+#include "Utility.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+//! State shared by the calling thread and the persistent worker threads.
+//! Allocated on the heap and never freed, so that detached workers never see it destroyed at exit.
+struct WorkerPool {
+    std::mutex mutex;
+    //! Signaled when a new job is posted.
+    std::condition_variable wakeUp;
+    //! Signaled when the last helper finishes a job.
+    std::condition_variable done;
+    //! Incremented for each job posted.
+    uint64_t generation = 0;
+    //! Number of threads created so far, not counting the calling thread.
+    unsigned threadCount = 0;
+    //! Number of helper threads that participate in the current job.
+    unsigned helperCount = 0;
+    //! Number of helpers that have not yet finished the current job.
+    unsigned busyCount = 0;
+    const std::function<void(size_t)>* job = nullptr;
+    size_t jobSize = 0;
+    //! Next index of the current job to be claimed.
+    std::atomic<size_t> next;
+
+    //! Claim and run indices of the current job until none are left.
+    void run(const std::function<void(size_t)>& f, size_t n) {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < n; )
+            f(i);
+    }
+    void helperLoop(unsigned k);
+    void grow(unsigned n);
+};
+
+WorkerPool* ThePool;
+
+unsigned TheWorkerCount;
+
+void WorkerPool::helperLoop(unsigned k) {
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wakeUp.wait(lock, [&] {return generation!=seen; });
+        seen = generation;
+        if (k<helperCount) {
+            const std::function<void(size_t)>& f = *job;
+            const size_t n = jobSize;
+            lock.unlock();
+            run(f, n);
+            lock.lock();
+            if (--busyCount==0)
+                done.notify_one();
+        }
+    }
+}
+
+//! Ensure that there are at least n helper threads.
+void WorkerPool::grow(unsigned n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (; threadCount<n; ++threadCount)
+        std::thread([this](unsigned k) {helperLoop(k); }, threadCount).detach();
+}
+
+} // (anonymous)
+
+void SetWorkerCount(unsigned n) {
+    if (n==0)
+        n = std::thread::hardware_concurrency();
+    TheWorkerCount = Clip(1u, N_WORKER_MAX, n);
+}
+
+unsigned WorkerCount() {
+    if (!TheWorkerCount)
+        SetWorkerCount(0);
+    return TheWorkerCount;
+}
+
+void ParallelFor(size_t n, const std::function<void(size_t)>& f) {
+    const unsigned helperCount = unsigned(Min<size_t>(WorkerCount(), n)) - (n>0);
+    if (helperCount==0) {
+        for (size_t i=0; i<n; ++i)
+            f(i);
+        return;
+    }
+    if (!ThePool)
+        ThePool = new WorkerPool;
+    WorkerPool& p = *ThePool;
+    p.grow(helperCount);
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        Assert(p.busyCount==0);     // Nested or concurrent calls are not supported
+        p.job = &f;
+        p.jobSize = n;
+        p.next.store(0, std::memory_order_relaxed);
+        p.helperCount = p.busyCount = helperCount;
+        ++p.generation;
+    }
+    p.wakeUp.notify_all();
+    p.run(f, n);
+    std::unique_lock<std::mutex> lock(p.mutex);
+    p.done.wait(lock, [&] {return p.busyCount==0; });
+    p.job = nullptr;
+}
@@ -0,0 +1,41 @@
+/* Copyright 2011-2021 Arch D. Robison
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/******************************************************************************
+ Fork-join parallelism for the drawing routines.
+*******************************************************************************/
+
+#ifndef Parallel_H
+#define Parallel_H
+
+#include <cstddef>
+#include <functional>
+
+//! Maximum number of workers, including the calling thread.
+constexpr unsigned N_WORKER_MAX = 16;
+
+//! Set number of workers used by ParallelFor, including the calling thread.
+//! 0 means use the hardware concurrency.  1 means do everything on the calling thread.
+void SetWorkerCount(unsigned n);
+
+//! Number of workers used by ParallelFor.  Always in [1,N_WORKER_MAX].
+unsigned WorkerCount();
+
+//! Invoke f(i) for each i in [0,n), possibly concurrently, and return after all invocations finish.
+//!
+//! The calling thread participates.  Invocations must not call ParallelFor.
+void ParallelFor(size_t n, const std::function<void(size_t)>& f);
+
+#endif /* Parallel_H */
@@ -0,0 +1,222 @@
+/* Copyright 2011-2021 Arch D. Robison
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "Sort.h"
+#include <algorithm>
+#include <climits>
+#include <emmintrin.h>
+
+namespace {
+
+//! Put keys a and b in ascending order, and permute their indices the same way.  Has no branches.
+inline void CompareExchange(int32_t key[], uint32_t index[], size_t a, size_t b) {
+    const int32_t ka = key[a];
+    const int32_t kb = key[b];
+    const uint32_t ia = index[a];
+    const uint32_t ib = index[b];
+    const bool swap = kb<ka;
+    key[a] = swap ? kb : ka;
+    key[b] = swap ? ka : kb;
+    index[a] = swap ? ib : ia;
+    index[b] = swap ? ia : ib;
+}
+
+//! A comparator of a sorting network.
+struct Comparator {
+    uint8_t a, b;
+};
+
+//! Comparators of Batcher's odd-even merge sort for N inputs, where N is a power of two.
+template<size_t N>
+class OddEvenMergeNetwork {
+    static constexpr size_t size = N==4 ? 5 : N==8 ? 19 : 63;
+    Comparator myArray[size];
+public:
+    OddEvenMergeNetwork() {
+        size_t n = 0;
+        for (size_t p=1; p<N; p<<=1)
+            for (size_t k=p; k>=1; k>>=1)
+                for (size_t j=k%p; j+k<N; j+=2*k)
+                    for (size_t i=0; i<Min(k, N-j-k); ++i)
+                        if ((i+j)/(2*p)==(i+j+k)/(2*p)) {
+                            Assert(n<size);
+                            myArray[n].a = uint8_t(i+j);
+                            myArray[n].b = uint8_t(i+j+k);
+                            ++n;
+                        }
+        Assert(n==size);
+    }
+    //! Sort N packed key-index pairs.
+    void sort(uint64_t x[]) const {
+        for (const Comparator& c: myArray) {
+            const uint64_t u = x[c.a];
+            const uint64_t v = x[c.b];
+            x[c.a] = Min(u, v);
+            x[c.b] = Max(u, v);
+        }
+    }
+};
+
+const OddEvenMergeNetwork<4> Network4;
+const OddEvenMergeNetwork<8> Network8;
+const OddEvenMergeNetwork<16> Network16;
+
+//! Pad key[n:m] with keys that sort last.
+void PadKeys(int32_t key[], uint32_t index[], size_t n, size_t m) {
+    for (size_t j=n; j<m; ++j) {
+        key[j] = INT_MAX;
+        index[j] = 0;
+    }
+}
+
+//! Bits where mask is set come from a, others from b.
+inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+//! For t in [0,j), put elements first+t and first+j+t in ascending order if up, otherwise in descending order.
+//! Requires j>=4.
+void BitonicStep(int32_t key[], uint32_t index[], size_t first, size_t j, bool up) {
+    Assert(j>=4);
+    int32_t* kl = key+first;
+    int32_t* kh = kl+j;
+    uint32_t* il = index+first;
+    uint32_t* ih = il+j;
+    for (size_t t=0; t<j; t+=4) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(kl+t));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(kh+t));
+        const __m128i ia = _mm_loadu_si128((const __m128i*)(il+t));
+        const __m128i ib = _mm_loadu_si128((const __m128i*)(ih+t));
+        // Lanes to be swapped
+        const __m128i swap = up ? _mm_cmpgt_epi32(a, b) : _mm_cmplt_epi32(a, b);
+        _mm_storeu_si128((__m128i*)(kl+t), Select(swap, b, a));
+        _mm_storeu_si128((__m128i*)(kh+t), Select(swap, a, b));
+        _mm_storeu_si128((__m128i*)(il+t), Select(swap, ib, ia));
+        _mm_storeu_si128((__m128i*)(ih+t), Select(swap, ia, ib));
+    }
+}
+
+//! Exchange elements of v and iv in lanes paired by Shuffle, such that lanes in takeMin get the smaller key of their pair.
+/** Both lanes of a pair swap or neither does, so indices remain a permutation. */
+template<int Shuffle>
+inline void BitonicStepWithinVector(__m128i& v, __m128i& iv, __m128i takeMin) {
+    const __m128i p = _mm_shuffle_epi32(v, Shuffle);
+    const __m128i ip = _mm_shuffle_epi32(iv, Shuffle);
+    const __m128i swap = Select(takeMin, _mm_cmplt_epi32(p, v), _mm_cmplt_epi32(v, p));
+    v = Select(swap, p, v);
+    iv = Select(swap, ip, iv);
+}
+
+//! Do the steps of a bitonic merge with distances 2 and 1 on the four elements at first, as part of merging sequences of length k.
+void BitonicStepsWithinVector(int32_t key[], uint32_t index[], size_t first, size_t k) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(key+first));
+    __m128i iv = _mm_loadu_si128((const __m128i*)(index+first));
+    // Lane masks are listed from lane 3 down to lane 0.
+    if (k==2) {
+        // Lanes 0-1 go up, lanes 2-3 go down.
+        BitonicStepWithinVector<_MM_SHUFFLE(2, 3, 0, 1)>(v, iv, _mm_set_epi32(-1, 0, 0, -1));
+    } else {
+        // All lanes go the same direction.
+        const __m128i down = (first&k) ? _mm_set1_epi32(-1) : _mm_setzero_si128();
+        BitonicStepWithinVector<_MM_SHUFFLE(1, 0, 3, 2)>(v, iv, _mm_xor_si128(down, _mm_set_epi32(0, 0, -1, -1)));
+        BitonicStepWithinVector<_MM_SHUFFLE(2, 3, 0, 1)>(v, iv, _mm_xor_si128(down, _mm_set_epi32(0, -1, 0, -1)));
+    }
+    _mm_storeu_si128((__m128i*)(key+first), v);
+    _mm_storeu_si128((__m128i*)(index+first), iv);
+}
+
+} // (anonymous)
+
+void SortKeysByNetwork(int32_t key[], uint32_t index[], size_t n) {
+    Assert(n<=SORT_NETWORK_MAX);
+    if (n<=2) {
+        if (n==2)
+            CompareExchange(key, index, 0, 1);
+        return;
+    }
+    // Pack each key with its index so that a comparator is just a min and a max.
+    // Flipping the sign bit of the key makes unsigned order match signed order.
+    constexpr uint32_t flip = 0x80000000u;
+    uint64_t x[SORT_NETWORK_MAX];
+    const size_t m = RoundUpToPowerOfTwo(n);
+    for (size_t j=0; j<n; ++j)
+        x[j] = uint64_t(uint32_t(key[j])^flip)<<32 | index[j];
+    for (size_t j=n; j<m; ++j)
+        x[j] = UINT64_MAX;
+    if (m==4)
+        Network4.sort(x);
+    else if (m==8)
+        Network8.sort(x);
+    else
+        Network16.sort(x);
+    for (size_t j=0; j<n; ++j) {
+        key[j] = int32_t(uint32_t(x[j]>>32)^flip);
+        index[j] = uint32_t(x[j]);
+    }
+}
+
+void SortKeysBitonic(int32_t key[], uint32_t index[], size_t n) {
+    const size_t m = Max<size_t>(RoundUpToPowerOfTwo(n), 4);
+    PadKeys(key, index, n, m);
+    for (size_t k=2; k<=m; k<<=1) {
+        for (size_t j=k>>1; j>=4; j>>=1)
+            for (size_t i=0; i<m; i+=2*j)
+                // Element x of a bitonic sequence of length k goes up iff bit k of x is zero.
+                BitonicStep(key, index, i, j, (i&k)==0);
+        for (size_t i=0; i<m; i+=4)
+            BitonicStepsWithinVector(key, index, i, k);
+    }
+}
+
+void SortKeysRadix(int32_t key[], uint32_t index[], int32_t keyTmp[], uint32_t indexTmp[], size_t n) {
+    // Flipping the sign bit makes unsigned order match signed order.
+    constexpr uint32_t flip = 0x80000000u;
+    // Histogram of each byte of the keys
+    static_assert(sizeof(uint32_t)==4, "unexpected uint32_t size");
+    uint32_t count[4][256] = {};
+    for (size_t i=0; i<n; ++i) {
+        const uint32_t u = uint32_t(key[i])^flip;
+        for (int b=0; b<4; ++b)
+            ++count[b][u>>8*b & 0xFF];
+    }
+    int32_t* src = key;
+    int32_t* dst = keyTmp;
+    uint32_t* isrc = index;
+    uint32_t* idst = indexTmp;
+    for (int b=0; b<4; ++b) {
+        uint32_t* c = count[b];
+        // Skip pass if all keys have the same byte, which is common for the exponent byte.
+        if (c[(uint32_t(src[0])^flip)>>8*b & 0xFF]==n)
+            continue;
+        // Convert counts to starting offsets
+        uint32_t sum = 0;
+        for (int d=0; d<256; ++d) {
+            const uint32_t tmp = c[d];
+            c[d] = sum;
+            sum += tmp;
+        }
+        for (size_t i=0; i<n; ++i) {
+            const size_t k = c[(uint32_t(src[i])^flip)>>8*b & 0xFF]++;
+            dst[k] = src[i];
+            idst[k] = isrc[i];
+        }
+        std::swap(src, dst);
+        std::swap(isrc, idst);
+    }
+    if (src!=key) {
+        std::copy(src, src+n, key);
+        std::copy(isrc, isrc+n, index);
+    }
+}
@@ -0,0 +1,124 @@
+/* Copyright 2011-2021 Arch D. Robison
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/******************************************************************************
+ Sorting by float keys, with kernels chosen by size.
+*******************************************************************************/
+
+#ifndef Sort_H
+#define Sort_H
+
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include "AssertLib.h"
+#include "Utility.h"
+
+//! Map x to a signed integer such that integer order matches float order.  x must not be a NaN.
+inline int32_t OrderedKey(float x) {
+    int32_t i;
+    std::memcpy(&i, &x, sizeof(i));
+    // Flip magnitude bits of negative values.
+    return i ^ (uint32_t(i>>31)>>1);
+}
+
+//! Arrays no longer than this are sorted with a sorting network.
+constexpr size_t SORT_NETWORK_MAX = 16;
+
+//! Arrays no longer than this, and longer than SORT_NETWORK_MAX, are sorted with a bitonic sort.
+//! Longer arrays are sorted with a radix sort.  See UnitTest/TestSort.cpp for the crossover benchmark.
+constexpr size_t SORT_BITONIC_MAX = 128;
+
+//! Sort key[0:n] and permute index[0:n] the same way, using a sorting network.  Requires n<=SORT_NETWORK_MAX.
+void SortKeysByNetwork(int32_t key[], uint32_t index[], size_t n);
+
+//! Sort key[0:n] and permute index[0:n] the same way, using a bitonic sort.
+//! The arrays must have room for n rounded up to a power of two, and for at least four elements.
+void SortKeysBitonic(int32_t key[], uint32_t index[], size_t n);
+
+//! Sort key[0:n] and permute index[0:n] the same way, using an LSD radix sort.
+//! keyTmp and indexTmp must have room for n elements.
+void SortKeysRadix(int32_t key[], uint32_t index[], int32_t keyTmp[], uint32_t indexTmp[], size_t n);
+
+//! Smallest power of two that is at least n.
+inline size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t p = 1;
+    while (p<n)
+        p <<= 1;
+    return p;
+}
+
+//! Sorts arrays of T by a float key.
+/** Holds scratch space, so concurrent sorts need separate KeySorters. */
+template<typename T>
+class KeySorter : NoCopy {
+    SimpleArray<int32_t> myKey[2];
+    SimpleArray<uint32_t> myIndex[2];
+    SimpleArray<T> myItem;
+    void reserve(size_t n) {
+        if (myItem.size()<n) {
+            size_t m = RoundUpToPowerOfTwo(n);
+            for (int k=0; k<2; ++k) {
+                myKey[k].resize(m);
+                myIndex[k].resize(m);
+            }
+            myItem.resize(m);
+        }
+    }
+    //! Permute [first,first+n) so that element k becomes old element index[k].
+    void gather(T* first, const uint32_t index[], size_t n, T tmp[]) {
+        for (size_t k=0; k<n; ++k)
+            tmp[k] = first[index[k]];
+        for (size_t k=0; k<n; ++k)
+            first[k] = tmp[k];
+    }
+public:
+    //! Sort [first,last) so that key(*first) is nondecreasing.  The sort is not stable.
+    template<typename Key>
+    void sort(T* first, T* last, Key key) {
+        Assert(first<=last);
+        const size_t n = last-first;
+        if (n<=2) {
+            // Packing keys costs more than it saves.
+            if (n==2 && key(first[1])<key(first[0]))
+                std::swap(first[0], first[1]);
+        } else if (n<=SORT_NETWORK_MAX) {
+            int32_t k[SORT_NETWORK_MAX];
+            uint32_t i[SORT_NETWORK_MAX];
+            T tmp[SORT_NETWORK_MAX];
+            for (size_t j=0; j<n; ++j) {
+                k[j] = OrderedKey(key(first[j]));
+                i[j] = uint32_t(j);
+            }
+            SortKeysByNetwork(k, i, n);
+            gather(first, i, n, tmp);
+        } else {
+            reserve(n);
+            int32_t* k = myKey[0].begin();
+            uint32_t* i = myIndex[0].begin();
+            for (size_t j=0; j<n; ++j) {
+                k[j] = OrderedKey(key(first[j]));
+                i[j] = uint32_t(j);
+            }
+            if (n<=SORT_BITONIC_MAX)
+                SortKeysBitonic(k, i, n);
+            else
+                SortKeysRadix(k, i, myKey[1].begin(), myIndex[1].begin(), n);
+            gather(first, i, n, myItem.begin());
+        }
+    }
+};
+
+#endif /* Sort_H */
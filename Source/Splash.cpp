@@ -104,17 +104,17 @@ void Splash::initialize(NimblePixMap& window) {
 }
 
 void Splash::draw(NimblePixMap& window) {
-    Ant* a = Ant::openBuffer();
-    // FIXME - add shorthand constructor to CompoundRegion for rectangular regions.
-    CompoundRegion region;
-    region.buildRectangle(Point(0, 0), Point(window.width(), window.height()));
+    size_t n = SplashBackground.size();
+    for (size_t k=0; k<N_Button; ++k)
+        n += ButtonText[k].antCountMax();
+    Ant* a = Ant::openBuffer(n);
     for (size_t k=0; k<N_Button; ++k) {
         VoronoiText& b = ButtonText[k];
         Point p = SplashViewTransform.transform(ButtonCircle[k].center()) - Center(b);
         a = ButtonText[k].copyToAnts(a, p);
     }
     a = SplashBackground.copyToAnts(a, SplashViewTransform);
-    Ant::closeBufferAndDraw(window, region, a, true);
+    Ant::closeBufferAndDraw(window, NimbleRect(0, 0, window.width(), window.height()), a, true);
 #if 0
     // Code for showing centers
     for (size_t k=0; k<N_Button; ++k) {
@@ -14,30 +14,111 @@
  */
 
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
 #include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <type_traits>
 #include "Config.h"
 #include "AssertLib.h"
+#include "Parallel.h"
 #include "Region.h"
+#include "Sort.h"
 #include "Voronoi.h"
 #include "Outline.h"
 
+//! If 1, segment boundaries are 46.18 fixed-point integers.  If 0, they are floats.
+#define FIXED_POINT_BOUNDARY 1
+
 namespace {
 
+#if FIXED_POINT_BOUNDARY
+//! x coordinate of a segment boundary, with 46 bits of integer part and 18 bits of fraction.
+/** 64 bits leave room for any window, plus the slope margin, that a RegionSegment can describe.
+    With 32 bits, windows 4096 or more pixels wide would overflow. */
+using Boundary = int64_t;
+
+constexpr int boundaryFractionBits = 18;
+constexpr float boundaryScale = 1<<boundaryFractionBits;
+
+//! Boundaries are clipped to (-boundaryLimit,boundaryLimit), which is the range of a RegionSegment.
+constexpr float boundaryLimit = float(RegionSegment::valueTypeMax)+1;
+
+//! Bisectors that move more pixels than this per scan line are treated as moving this much.
+constexpr float boundarySlopeMax = 1<<12;
+
+inline Boundary ToBoundary(int x) {
+    return Boundary(x)<<boundaryFractionBits;
+}
+
+//! Values beyond the representable range, such as the dummy boundaries at +-FLT_MAX, are clipped.
+inline Boundary ToBoundary(float x) {
+    return Boundary(std::llround(Clip(-boundaryLimit, boundaryLimit-1, x)*boundaryScale));
+}
+
+inline float BoundaryToFloat(Boundary x) {
+    return x*(1/boundaryScale);
+}
+
+//! Round toward negative infinity
+inline int BoundaryToInt(Boundary x) {
+    return x>>boundaryFractionBits;
+}
+
+//! Boundary where the perpendicular bisector of l--r crosses scan line y, computed in double from the unclamped slope.
+/** Depends only on l, r, and y, so a sweep and its stripes agree. */
+inline Boundary ExactBisectorBoundary(Point l, Point r, float y) {
+    constexpr double limit = boundaryLimit;
+    const double slope = (double(l.y)-r.y)/(double(r.x)-l.x);
+    const double x = 0.5*(double(l.x)+r.x) + slope*(y-0.5*(double(l.y)+r.y));
+    return Boundary(std::llround(Clip(-limit, limit-1, x)*boundaryScale));
+}
+
+#else
+//! x coordinate of a segment boundary
+using Boundary = float;
+
+inline Boundary ToBoundary(float x) {
+    return x;
+}
+
+inline float BoundaryToFloat(Boundary x) {
+    return x;
+}
+
+inline int BoundaryToInt(Boundary x) {
+    return RegionSegment::valueType(x);
+}
+#endif /* FIXED_POINT_BOUNDARY */
+
+//! Sites closer than this in both x and y are coincident.
+constexpr float coincidentSiteDistance = 1.0f/256;
+
+//! Walks Ants in order of increasing distance from a scan line, skipping Ants marked by MarkCoincidentSites.
 class WalkByY {
-    Ant* myL;
-    Ant* myU;
+    const Ant* myL;
+    const Ant* myU;
+    const Ant* myFirst;
+    //! mySkip[i] is nonzero if myFirst[i] is skipped.
+    const uint8_t* mySkip;
+    bool isSkipped(const Ant* a) const {
+        return mySkip[a-myFirst];
+    }
     static float subtract(float a, float b) {
         Assert(a>=b);
         return a-b;
     }
 #if ASSERTIONS
-    Ant* myBegin;
-    Ant* myEnd;
+    const Ant* myBegin;
+    const Ant* myEnd;
 #endif /* ASSERTIONS */
 public:
     WalkByY() {}
-    const Ant& startWalk(float y, Ant* first, Ant* last);
+    //! Start walk from scan line y over Ants in [first,last).  skip[i] is nonzero if first[i] is to be skipped.
+    const Ant& startWalk(float y, const Ant* first, const Ant* last, const uint8_t* skip);
 
     /** Get next Ant that is above or below lineY if it is within distance d of lineY.
         Otherwise return NULL. */
@@ -59,7 +140,7 @@ public:
 #endif /* ASSERTIONS */
 };
 
-inline const Ant& WalkByY::startWalk(float y, Ant* first, Ant* last) {
+inline const Ant& WalkByY::startWalk(float y, const Ant* first, const Ant* last, const uint8_t* skip) {
     // Next 5 assertions are caller's responsibility
     Assert(first[0].y==-AntInfinity);
     Assert(last[-1].y==AntInfinity);
@@ -70,16 +151,21 @@ inline const Ant& WalkByY::startWalk(float y, Ant* first, Ant* last) {
     myBegin = first;
     myEnd = last;
 #endif /* ASSERTIONS */
+    myFirst = first;
+    mySkip = skip;
     Ant tmp;
     tmp.y = y;
-    Ant* u = std::upper_bound(first, last, tmp, Ant::lessY());
-    Ant* l = u-1;
+    const Ant* u = std::upper_bound(first, last, tmp, Ant::lessY());
+    const Ant* l = u-1;
     Assert(first<l || u<last);
     float dl = subtract(y, l->y);
     float du = subtract(u->y, y);
-    Ant* a = dl<du ? l : u;
+    const Ant* a = dl<du ? l : u;
     myL=a-1;
     myU=a+1;
+    while (isSkipped(a))
+        a = subtract(y, myL->y)<fabs(myU->y-y) ? myL-- : myU++;
+    Assert(!a->isBookend());
     Assert(myL>=myBegin);
     Assert(myU<myEnd);
     return *a;
@@ -90,145 +176,303 @@ inline const Ant* WalkByY::getNextAboveOrBelowIf(float y, float d) {
     Assert(myU<myEnd);
     Assert(0<=d);
     Assert(d<AntInfinity);
-    // Choose remaining ant that is closest to y.
-    float dl = subtract(y, myL->y);
-    float du = fabs(myU->y-y);
-    if (dl<du)
-        return dl<d ? myL-- : NULL;
-    else
-        return du<d ? myU++ : NULL;
+    for (;;) {
+        // Choose remaining ant that is closest to y.
+        float dl = subtract(y, myL->y);
+        float du = fabs(myU->y-y);
+        const Ant* a;
+        if (dl<du) {
+            if (!(dl<d))
+                return NULL;
+            a = myL--;
+        } else {
+            if (!(du<d))
+                return NULL;
+            a = myU++;
+        }
+        if (!isSkipped(a))
+            return a;
+    }
 }
 
-struct DeferredAnt : Ant {
-    float top;
-    struct greaterTop {
-        bool operator()(const DeferredAnt& a, const DeferredAnt& b) const { return a.top>b.top; }
-    };
+//! An Ant whose cell will not intersect the scan line until a later scan line.
+struct DeferredAnt {
+    //! Pointer into the sorted buffer of Ants
+    const Ant* site;
+    //! Next DeferredAnt in the same bucket or free list.
+    DeferredAnt* next;
 };
 
-//! Base class is coordinates of the ant.
-struct VoronoiSegment : public Ant {
-    // Next segment in list of live segments
-    VoronoiSegment* next;
-    // Previous segment in list of live segments
-    VoronoiSegment* prev;
+//! Number of buckets of deferred Ants.  Buckets are used round robin, one per scan line.
+/** It is a power of two that is at least the number of scan lines in a region, so that DrawVoronoi never
+    reuses a bucket.  Sweeps of taller images defer Ants at most N_BUCKET_MAX-1 scan lines ahead. */
+constexpr int N_BUCKET_MAX = 4096;
+static_assert((N_BUCKET_MAX&(N_BUCKET_MAX-1))==0, "N_BUCKET_MAX must be a power of two");
+static_assert(N_BUCKET_MAX>=Outline::lineWidth+MAX_STRIPE_HEIGHT+1, "N_BUCKET_MAX too small for a region");
+
+//! Live segments in order of increasing x, stored as a structure of arrays.
+/** Segment k is the part of the current scan line closest to site k.  It spans [left[k],left[k+1]).
+    The first and last segments are dummies with sites at x=-FLT_MAX and x=FLT_MAX. */
+struct LiveArrays {
+    // Coordinates of the site
+    std::vector<float> x;
+    std::vector<float> y;
     // Left end of segment
-    float left;
+    std::vector<Boundary> left;
     // Change in left per scan line.
-    float slope;
-    Outline::idType outlineId;
-#if ASSERTIONS
-    float yWhenSlopeWasSet;
-    float originalLeft;
-#endif /* ASSERTIONS */
-    void assign(const Ant& a) {
-        static_cast<Ant&>(*this) = a;
+    std::vector<Boundary> slope;
+    // Computing left afresh for each scan line, instead of accumulating slope, makes left depend only on
+    // the scan line, not on where the sweep started, so that stripes swept independently agree with a single sweep.
+#if FIXED_POINT_BOUNDARY
+    // Value of left at scan line 0, modulo 2^64.
+    // Because the arithmetic is exact, left for a scan line is the same as if slope had been accumulated.
+    std::vector<uint64_t> base;
+#else
+    // Point on the left boundary from which left is computed for each scan line.
+    std::vector<float> anchorX;
+    std::vector<float> anchorY;
+#endif
+    std::vector<OutlinedColor> color;
+    // Index of site in the sorted buffer of Ants
+    std::vector<uint32_t> site;
+
+    //! Number of segments that the arrays have room for.
+    size_t capacity() const {
+        return x.size();
+    }
+    //! Make room for n segments.  Existing segments are preserved.
+    void resize(size_t n) {
+        x.resize(n);
+        y.resize(n);
+        left.resize(n);
+        slope.resize(n);
+#if FIXED_POINT_BOUNDARY
+        base.resize(n);
+#else
+        anchorX.resize(n);
+        anchorY.resize(n);
+#endif
+        color.resize(n);
+        site.resize(n);
+    }
+
+    Point point(size_t k) const {
+        return Point(x[k], y[k]);
+    }
+    //! Set site of segment k to Ant a, which is at the given index in the buffer of Ants.
+    void assign(size_t k, const Ant* a, size_t index) {
+        x[k] = a->x;
+        y[k] = a->y;
+        color[k] = a->color;
+        site[k] = uint32_t(index);
         // Skip initialization of left. It is computed later.
-        if (a.color.hasExterior())
-            outlineId = Outline::newId();
-        else
-            outlineId = Outline::idType::null;
+    }
+    //! Copy segment j of src to segment k.
+    void copy(size_t k, const LiveArrays& src, size_t j) {
+        x[k] = src.x[j];
+        y[k] = src.y[j];
+        left[k] = src.left[j];
+        slope[k] = src.slope[j];
+#if FIXED_POINT_BOUNDARY
+        base[k] = src.base[j];
+#else
+        anchorX[k] = src.anchorX[j];
+        anchorY[k] = src.anchorY[j];
+#endif
+        color[k] = src.color[j];
+        site[k] = src.site[j];
+    }
+    //! Copy segments [j,j+n) of src to segments [k,k+n).  The two arrays must be distinct.
+    void copy(size_t k, const LiveArrays& src, size_t j, size_t n) {
+        Assert(&src!=this);
+        std::copy_n(src.x.begin()+j, n, x.begin()+k);
+        std::copy_n(src.y.begin()+j, n, y.begin()+k);
+        std::copy_n(src.left.begin()+j, n, left.begin()+k);
+        std::copy_n(src.slope.begin()+j, n, slope.begin()+k);
+#if FIXED_POINT_BOUNDARY
+        std::copy_n(src.base.begin()+j, n, base.begin()+k);
+#else
+        std::copy_n(src.anchorX.begin()+j, n, anchorX.begin()+k);
+        std::copy_n(src.anchorY.begin()+j, n, anchorY.begin()+k);
+#endif
+        std::copy_n(src.color.begin()+j, n, color.begin()+k);
+        std::copy_n(src.site.begin()+j, n, site.begin()+k);
+    }
+    //! Left end of segment k on scan line y.  Inexact if isSteep(k).
+    Boundary leftAt(size_t k, float y) const {
+#if FIXED_POINT_BOUNDARY
+        // Unsigned arithmetic wraps, and the true value of left always fits in a Boundary.
+        return Boundary(base[k] + uint64_t(slope[k])*uint64_t(int64_t(y)));
+#else
+        return anchorX[k] + slope[k]*(y-anchorY[k]);
+#endif
+    }
+#if FIXED_POINT_BOUNDARY
+    //! True if the slope of segment k was clamped to boundarySlopeMax.
+    bool isSteep(size_t k) const {
+        return std::abs(slope[k])>=ToBoundary(boundarySlopeMax);
+    }
+#endif
+    //! Make left end of segment k a vertical line at x.
+    void setVertical(size_t k, float x_) {
+        left[k] = ToBoundary(x_);
+        slope[k] = 0;
+#if FIXED_POINT_BOUNDARY
+        base[k] = left[k];
+#else
+        anchorX[k] = x_;
+        anchorY[k] = 0;
+#endif
     }
 };
 
-#define STATISTICS 0
+//! Shape of a region swept by VoronoiRasterizer, when the region is a CompoundRegion.
+/** If OneSegmentPerLine is true, no scan line of the region has more than one RegionSegment. */
+template<bool OneSegmentPerLine>
+class CompoundShape {
+    const CompoundRegion& myRegion;
+public:
+    static constexpr bool oneSegmentPerLine = OneSegmentPerLine;
+    CompoundShape(const CompoundRegion& region) : myRegion(region) {}
+    int top() const { return myRegion.top(); }
+    int bottom() const { return myRegion.bottom(); }
+    bool empty(int y) const { return myRegion.empty(y); }
+    int left(int y) const { return myRegion.left(y); }
+    int right(int y) const { return myRegion.right(y); }
+    const RegionSegment* begin(int y) const { return myRegion.begin(y); }
+    const RegionSegment* end(int y) const {
+        Assert(!OneSegmentPerLine || myRegion.end(y)-myRegion.begin(y)<=1);
+        return myRegion.end(y);
+    }
+#if ASSERTIONS
+    int lineWidth() const { return myRegion.lineWidth; }
+#endif
+};
 
-#if STATISTICS
-struct Stats {
-    unsigned long mergeCount;
-    unsigned long liveTotal;
-    unsigned long frontierTotal;
-    unsigned long emptyFrontierCount;
-} TheStats;
-#define STAT(fieldExpr) (TheStats.fieldExpr)
-#else
-#define STAT(expr) ((void)0)
+//! Shape of a region swept by VoronoiRasterizer, when the region is a rectangle inside the window.
+class RectangleShape {
+    RegionSegment mySegment;
+    int myTop, myBottom;
+public:
+    static constexpr bool oneSegmentPerLine = true;
+    RectangleShape(const NimbleRect& rect) : RectangleShape(rect.left, rect.top, rect.right, rect.bottom) {}
+    //! Rectangle [left,right) x [top,bottom).  Unlike a NimbleRect, it may be taller than an int16_t allows.
+    RectangleShape(int left, int top, int right, int bottom) :
+        mySegment{RegionSegment::valueType(left), RegionSegment::valueType(right)}, myTop(top), myBottom(bottom) {}
+    int top() const { return myTop; }
+    int bottom() const { return myBottom; }
+    bool empty(int) const { return false; }
+    int left(int) const { return mySegment.left; }
+    int right(int) const { return mySegment.right; }
+    const RegionSegment* begin(int) const { return &mySegment; }
+    const RegionSegment* end(int) const { return &mySegment+1; }
+#if ASSERTIONS
+    int lineWidth() const { return 0; }
 #endif
+};
 
-class VoronoiRasterizer {
-    //! Root of list of free segments
-    VoronoiSegment* freeList;
-    //! Next free segment
-    VoronoiSegment* freePtr;
-    //! Pointer to array of segments
-    VoronoiSegment* liveArray;
-
-    //! Dummy segment on left.  
-    VoronoiSegment leftDummy;
-    //! Dummy segment on right
-    VoronoiSegment rightDummy;
-
-    Ant* const frontierFirst;
-    Ant* frontierLast;
-    DeferredAnt* const heapFirst;
-    DeferredAnt* heapLast;
+//! Box around the rows of a shape that are not empty.  If all rows are empty, minY>maxY.
+struct BoundingBox {
     float minX, maxX, minY, maxY;
-    float lineY;
+    bool empty() const { return minY>maxY; }
+};
 
-    //! Insert segment between i and k.
-    /** Does not require that i and k be linked. */
-    VoronoiSegment* insert(VoronoiSegment* i, VoronoiSegment* k) {
-        // Grab a segment off the freelist if possible, otherwise get from buffer.
-        VoronoiSegment* j = freeList;
-        if (j) {
-            freeList = j->next;
-        } else {
-            j = freePtr++;
-        }
-        i->next = j;
-        k->prev = j;
-        j->prev = i;
-        j->next = k;
-        return j;
-    }
-
-    //! Erase segment between i and k.
-    void erase(VoronoiSegment* i, VoronoiSegment* k) {
-        Assert(i->next->next==k);
-        Assert(i==k->prev->prev);
-        VoronoiSegment* j = i->next;
-        i->next = k;
-        k->prev = i;
-        j->next = freeList;
-        freeList = j;
-    }
-
-    //! Replace segments in linked open interval (i,k) with a a fresh segment, and return a pointer to the latter.
-    VoronoiSegment* replaceSegmentsBetweenWithNewSegment(VoronoiSegment* i, VoronoiSegment* k) {
-        if (i->next!=k) {
-            // Move replaced segments to freelist
-            k->prev->next = freeList;
-            freeList = i->next;
+template<typename Shape>
+BoundingBox BoundingBoxOf(const Shape& shape) {
+    // FIXME - CompoundRegion should be returning a top() that is non-empty
+    BoundingBox box = {FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX};
+    for (int y=shape.top(); y<shape.bottom(); ++y) {
+        if (!shape.empty(y)) {
+            if (y<box.minY) box.minY = y;
+            if (y>box.maxY) box.maxY = y;
+            float l = shape.left(y);
+            Assert(-shape.lineWidth()<=l);
+            if (l<box.minX) box.minX = l;
+            float r = shape.right(y);
+            if (r>box.maxX) box.maxX = r;
         }
-        return insert(i, k);
     }
+    return box;
+}
+
+class AntStream;
 
-    //! Put segment on heap if it might become visible later
-    // FIXME - use array of linked lists instead of a heap
-    void defer(const Ant& a, float top) {
+class VoronoiRasterizer {
+public:
+    struct bufferType;
+private:
+    //! Live segments
+    LiveArrays* live;
+    //! Destination for merging the frontier into live segments.  Swapped with live afterwards.
+    LiveArrays* spare;
+    //! Number of live segments, including the two dummies.
+    size_t liveSize;
+
+    //! Buffer that the arrays below are in.
+    bufferType& buffer;
+    const Ant** frontierFirst;
+    const Ant** frontierLast;
+    //! Sorts the frontier by x.  Each rasterizer has its own, since stripes are swept concurrently.
+    KeySorter<const Ant*>& frontierSorter;
+    //! bucketAt(y) is list of deferred Ants whose cells first intersect scan line y.
+    DeferredAnt** const bucket;
+    //! First scan line whose bucket has not been popped to the frontier.
+    int bucketNext;
+    //! Last scan line of the sweep.  Ants deferred past it are dropped.
+    int bucketLast;
+    //! Root of list of free DeferredAnts
+    DeferredAnt* deferredFreeList;
+    //! Next free DeferredAnt
+    DeferredAnt* deferredFreePtr;
+    //! First DeferredAnt in buffer
+    DeferredAnt* deferredFirst;
+    float minX, maxX, minY, maxY;
+    float lineY;
+    //! Ant buffer being swept.  Segments refer to Ants by their index in this buffer.
+    /** Changes only if moveSites is called. */
+    const Ant* antFirst;
+    //! skip[i] is nonzero if sweep skips antFirst[i].  Null for a rasterizer that only sweeps streams.
+    const uint8_t* skip;
+    //! Maximum over live boundaries [1,liveSize-2] of squared distance from the boundary to the site on its right.
+    float liveMaxDist2;
+    //! Index of a boundary that attains liveMaxDist2, or 0 if liveMaxDist2 must be recomputed.
+    size_t liveMaxIndex;
+    //! Scratch space for mergeFrontierIntoLive to record where it inserted segments.
+    uint32_t* inserted;
+
+    DeferredAnt*& bucketAt(int y) const {
+        return bucket[y&(N_BUCKET_MAX-1)];
+    }
+
+    //! Put Ant in bucket for first scan line that it might become visible on.
+    void defer(const Ant* a, float top) {
         // Following assertion is written in ! form so that it tolerates case where top is a NaN.
         Assert(!(top<lineY));
-        if (top<=maxY) {
-            // FIXME - ignore segment if it is beyond bottom of screen
-            DeferredAnt& d = *heapLast++;
-            static_cast<Ant&>(d) = a;
-            d.top = top;
-            std::push_heap(heapFirst, heapLast, DeferredAnt::greaterTop());
+        // Ignore Ant if it cannot become visible before the sweep ends.  Comparison also ignores a NaN.
+        if (top<=bucketLast) {
+            // Ant goes in bucket for first scan line y with top<=y that has not been popped yet.
+            // If that bucket is too far ahead to be distinct, the farthest bucket is used instead.
+            // Popping the Ant early is harmless, because the merge defers it again.
+            int y = Min(Max(int(std::ceil(top)), bucketNext), bucketNext+N_BUCKET_MAX-1);
+            DeferredAnt* d = deferredFreeList;
+            if (d) {
+                deferredFreeList = d->next;
+            } else {
+                Assert(deferredFreePtr<deferredFirst+buffer.deferred.size());
+                d = deferredFreePtr++;
+            }
+            DeferredAnt*& b = bucketAt(y);
+            d->site = a;
+            d->next = b;
+            b = d;
+            ++buffer.stats.count[VoronoiStat::pushes];
         }
     }
 
 #if ASSERTIONS
-    static bool assertOrderedByX(const VoronoiSegment* first, const VoronoiSegment* last) {
-        Assert(first<=last);
-        for (; first+2<last; ++first) {
-            Assert(first[0].x<=first[1].x);
-        }
-        return true;
-    }
-
     bool assertLeftOfFrontier(float x, const Ant& k) const {
         Assert(frontierFirst<=frontierLast);
-        return frontierFirst==frontierLast || x<=frontierFirst[0].x;
+        return frontierFirst==frontierLast || x<=frontierFirst[0]->x;
     }
 
     bool assertLiveIsOkay() const;
@@ -236,42 +480,126 @@ class VoronoiRasterizer {
 #endif /* ASSERTIONS */
 
     // Return true iff cell for j does not intersect current scan line
-    // Puts j on heap if it will intersect future scan line
-    bool processTriplet(const Point& i, const Ant& j, const Point& k);
+    // Defers j if it will intersect future scan line
+    bool processTriplet(const Point& i, const Ant* j, const Point& k);
+
+    // Set left and slope of segment k of a to be boundary between cells for l and that segment.
+    void setBoundary(const Point& l, LiveArrays& a, size_t k) const;
 
-    // Set left and slope of r to be boundary between cells for l and r
-    void setBoundary(const Point& l, VoronoiSegment& r) const;
+    //! Fix roundoff errors in order of boundaries of consecutive segments i, j, k, and l.
+    /** Segment l is optional.  Segments i and j are in "out", segment k and l are segments kIndex and kIndex+1 of "in". */
+    static void forceBoundaryOrder(LiveArrays& out, size_t j, LiveArrays& in, size_t kIndex, size_t inSize);
 
-    void forceBoundaryOrder(VoronoiSegment& j) const;
+    //! Ant for site of segment k of a
+    const Ant* siteOf(const LiveArrays& a, size_t k) const {
+        return antFirst+a.site[k];
+    }
+
+    //! Squared distance from left end of segment k of a to its site.
+    float leftDist2(const LiveArrays& a, size_t k) const {
+        return Dist2(a.x[k], a.y[k], BoundaryToFloat(a.left[k]), lineY);
+    }
+
+    //! Set liveMaxDist2 and liveMaxIndex from scratch.
+    void recomputeLiveMaxDist2();
+
+    //! Point at the arrays of buffer, and empty the frontier.
+    void bindBuffer() {
+        frontierFirst = frontierLast = buffer.frontier.data();
+        deferredFirst = buffer.deferred.data();
+        inserted = buffer.inserted.data();
+    }
 
 public:
+    //! Storage for a rasterizer.  The arrays grow to the largest number of Ants swept with the buffer.
     struct bufferType {
-        DeferredAnt heap[N_ANT_MAX+2];
-        Ant frontier[N_ANT_MAX+2];
-        VoronoiSegment segment[N_ANT_MAX+2];
+        std::vector<DeferredAnt> deferred;
+        DeferredAnt* bucket[N_BUCKET_MAX];
+        std::vector<const Ant*> frontier;
+        std::vector<uint32_t> inserted;
+        KeySorter<const Ant*> frontierSorter;
+        LiveArrays live[2];
+        //! Work done by rasterizers that used this buffer since the stats were last collected.
+        VoronoiStats stats;
+        //! Make room for sweeping n Ants, including bookends.
+        void reserve(size_t n) {
+            if (frontier.size()<n) {
+                const size_t m = RoundUpToPowerOfTwo(n);
+                deferred.resize(m);
+                frontier.resize(m);
+                inserted.resize(m);
+                for (LiveArrays& a: live)
+                    a.resize(m);
+            }
+        }
     };
 
-    VoronoiRasterizer(bufferType& buffer);
+    //! Construct rasterizer for sweeping n Ants, including bookends, that start at antFirst_.
+    //! skip_[i] is nonzero if antFirst_[i] is to be skipped.  It may be null if only sweepStream is called.
+    VoronoiRasterizer(bufferType& buffer_, const Ant* antFirst_, size_t n, const uint8_t* skip_=nullptr);
+
+    template<typename Shape>
+    void setBoundingBox(const Shape& shape) {
+        setBoundingBox(BoundingBoxOf(shape));
+    }
+
+    //! Set bounding box to one computed for the same region
+    void setBoundingBox(const BoundingBox& box) {
+        minX = box.minX;
+        maxX = box.maxX;
+        minY = box.minY;
+        maxY = box.maxY;
+    }
+
+    BoundingBox boundingBox() const {
+        return {minX, maxX, minY, maxY};
+    }
 
-    void setBoundingBox(const CompoundRegion& region);
+    const uint8_t* skipMarks() const { return skip; }
 
     float top() const { return minY; }
     float bottom() const { return maxY; }
 
     void setLine(float y) {
         lineY = y;
+        liveMaxIndex = 0;
+    }
+
+    //! Empty the buckets and prepare to defer Ants for scan lines [yFirst,yLast].
+    void startBuckets(int yFirst, int yLast) {
+        bucketNext = yFirst;
+        bucketLast = yLast;
+        for (int y=yFirst; y<=yLast && y-yFirst<N_BUCKET_MAX; ++y)
+            bucketAt(y) = nullptr;
+        deferredFreeList = nullptr;
+        deferredFreePtr = deferredFirst;
     }
 
-    //! Move all segments s with s.top<=top into the frontier.
-    void popHeapToFrontier(float top) {
-        while (heapFirst<heapLast && heapFirst->top<=top) {
-            std::pop_heap(heapFirst, heapLast, DeferredAnt::greaterTop());
-            *frontierLast++ = *--heapLast;
+    //! Move all deferred Ants that might be visible on scan line y into the frontier.
+    void popBucketsToFrontier(int y) {
+        Assert(y<=bucketLast);
+        for (; bucketNext<=y; ++bucketNext) {
+            DeferredAnt*& b = bucketAt(bucketNext);
+            if (DeferredAnt* d = b) {
+                const Ant** f = frontierLast;
+                for (;;) {
+                    *frontierLast++ = d->site;
+                    if (!d->next)
+                        break;
+                    d = d->next;
+                }
+                buffer.stats.count[VoronoiStat::pops] += frontierLast-f;
+                // Return whole list to free list
+                d->next = deferredFreeList;
+                deferredFreeList = b;
+                b = nullptr;
+            }
         }
     }
 
     //! Append segment to the frontier
-    void appendToFrontier(const Ant& a) {
+    void appendToFrontier(const Ant* a) {
+        Assert(frontierLast<frontierFirst+buffer.frontier.size());
         *frontierLast++ = a;
     }
 
@@ -282,130 +610,140 @@ public:
 
     //! True if live list is empty
     bool liveIsEmpty() const {
-        return leftDummy.next == &rightDummy;
+        return liveSize==2;
     };
 
-    void mergeIntoEmptyLive(const Ant& a);
+    void mergeIntoEmptyLive(const Ant* a);
 
     //! Merge frontier into live
     void mergeFrontierIntoLive();
 
-    // Compute maximum distance for a segment in the live list, and set n to length of live list (not including dummies)
-    float computeLiveMaxDist(size_t& n) const;
+    //! Compute maximum distance for a segment in the live list, and set n to length of live list (not including dummies)
+    /** Takes O(1) time unless the boundary that attained the maximum was replaced since the last call. */
+    float computeLiveMaxDist(size_t& n);
+
+    //! Send parts of live segments that are inside the region with the given shape to sink.
+    template<typename Shape, typename SpanSink>
+    void drawLive(SpanSink& sink, const Shape& shape);
+
+    //! Sweep scan lines [yFirst,yLast], starting with an empty live list, and send the spans to sink.
+    template<typename Shape, typename SpanSink>
+    void sweep(SpanSink& sink, const Shape& shape, const Ant* antLast, int yFirst, int yLast);
+
+    //! Sweep scan lines [0,shape.bottom()) of a RectangleShape with Ants pulled from stream.
+    /** Calls sink.finishRow(y) after the spans of scan line y are sent to sink. */
+    template<typename SpanSink>
+    void sweepStream(SpanSink& sink, const RectangleShape& shape, AntStream& stream);
 
-    // Draw live segments and advance their "left" to the next line
-    void drawLive(NimblePixMap& window, const CompoundRegion& region);
+    //! Set mark[i] to 1 if antFirst[i] is the site of a live segment or a deferred Ant.
+    void markSites(uint32_t* mark) const;
+
+    //! Tell rasterizer that Ant antFirst[i] that is marked by markSites has moved to newFirst[newIndex[i]].
+    /** Must not be called while the frontier is non-empty. */
+    void moveSites(const Ant* newFirst, const uint32_t* newIndex);
+
+    //! Make room for sweeping n Ants, including bookends, without disturbing the live list or deferred Ants.
+    /** Must not be called while the frontier is non-empty. */
+    void reserve(size_t n);
 
     void advanceLive();
 };
 
 #if ASSERTIONS
 bool VoronoiRasterizer::assertLiveIsOkay() const {
-    const VoronoiSegment& i = *leftDummy.next;
-    const VoronoiSegment& j = *i.next;
-    // Leftmost real segment should have artificial boundary
-    Assert(i.left==minX);
-    Assert(i.slope==0);
-
-    // Right dummy segment should have artificial boundary
-    const VoronoiSegment& l = rightDummy;
-    Assert(l.left==maxX);
+    const LiveArrays& a = *live;
+    const size_t n = liveSize;
+    Assert(2<=n && n<=a.capacity());
+    Assert(a.x[0]==-FLT_MAX);
+    Assert(a.x[n-1]==FLT_MAX);
+    if (n>2) {
+        // Right dummy segment should have artificial boundary
+        Assert(a.left[n-1]==ToBoundary(maxX));
+        // Leftmost real segment should have artificial boundary
+        Assert(a.left[1]==ToBoundary(minX));
+        Assert(a.slope[1]==0);
+    }
     // Check that boundaries are correct
-    for (VoronoiSegment* t = leftDummy.next; t; t=t->next) {
-        if (t==leftDummy.next) {
-            Assert(t->left==minX);
-        } else if (t==&rightDummy) {
-            Assert(t->left==maxX);
-        } else {
-            VoronoiSegment* s = t->prev;
-            float x = BisectorInterceptX(lineY, *s, *t);
-            float error = t->left - x;
-            // The error is typically much smaller.  
-            // However very long sides can accumulate 1/2 ulp error per scan line.
-            // For example, for a 2000x2000 pixel display, the accumulated error could be 1000 ulp.
-            // Furthermore, the monotonicty hacks can further bloat this.
-            /* FIXME - use fixed-point for "left" and "slope".  Use about 14 bits for integer part and 18 for fraction
-               That's better than current situation, which has only about 14 bits for the fraction. */
-            Assert(fabs(error)<=.6f || TolerateRoundoffErrors);
-        }
+    for (size_t t=2; t<n-1; ++t) {
+        float x = BisectorInterceptX(lineY, a.point(t-1), a.point(t));
+        float error = BoundaryToFloat(a.left[t]) - x;
+        // The error is typically much smaller, because left is recomputed for each scan line.
+        // However the monotonicty hacks can bloat it.
+        Assert(fabs(error)<=.6f || TolerateRoundoffErrors);
     }
     // Check that boundaries occur left to right.
-    VoronoiSegment* t;
-    for (VoronoiSegment* s = leftDummy.next; t=s->next; s=t) {
-        Assert(s->left <= t->left);
-    }
+    for (size_t t=2; t<n; ++t)
+        Assert(a.left[t-1] <= a.left[t]);
     return true;
 }
 #endif /* ASSERTIONS */
 
-VoronoiRasterizer::VoronoiRasterizer(bufferType& buffer) :
-    frontierFirst(buffer.frontier),
-    frontierLast(buffer.frontier),
-    freePtr(buffer.segment),
-    freeList(NULL),
-    heapFirst(buffer.heap),
-    heapLast(buffer.heap) {
-    // Create two-element list of dummy segments
-    VoronoiSegment& l = leftDummy;
-    VoronoiSegment& r = rightDummy;
-
-    l.x = -FLT_MAX;
-    l.y = 0;
-    l.color = 0;
-    l.left = -FLT_MAX;
-    l.slope = 0;
-    l.next = &r;
-    l.prev = NULL;
-
-    r.x = FLT_MAX;
-    r.y = 0;
-    r.color = 0;
-    r.left = FLT_MAX;
-    r.slope = 0;
-    r.next = NULL;
-    r.prev = &l;
-}
-
-void VoronoiRasterizer::setBoundingBox(const CompoundRegion& region) {
-    // FIXME - CompoundRegion should be returning a top() that is non-empty
-    minY = FLT_MAX;
-    maxY = -FLT_MAX;
-    minX = FLT_MAX;
-    maxX = -FLT_MAX;
-    for (int y=region.top(); y<region.bottom(); ++y) {
-        if (!region.empty(y)) {
-            if (y<minY) minY = y;
-            if (y>maxY) maxY = y;
-            float l = region.left(y);
-            Assert(-region.lineWidth<=l);
-            if (l<minX) minX = l;
-            float r = region.right(y);
-            if (r>maxX) maxX = r;
-        }
+VoronoiRasterizer::VoronoiRasterizer(bufferType& buffer_, const Ant* antFirst_, size_t n, const uint8_t* skip_) :
+    live(&buffer_.live[0]),
+    spare(&buffer_.live[1]),
+    liveSize(2),
+    buffer(buffer_),
+    frontierSorter(buffer_.frontierSorter),
+    bucket(buffer_.bucket),
+    antFirst(antFirst_),
+    skip(skip_),
+    liveMaxIndex(0) {
+    buffer.reserve(n);
+    bindBuffer();
+    // Create two-element list of dummy segments.  
+    // Merging copies the left dummy to the spare arrays, so it is initialized in both.
+    for (LiveArrays& a: buffer.live) {
+        a.x[0] = -FLT_MAX;
+        a.y[0] = 0;
+        a.color[0] = 0;
+        a.site[0] = 0;
+        a.setVertical(0, -FLT_MAX);
     }
+    LiveArrays& a = *live;
+    a.x[1] = FLT_MAX;
+    a.y[1] = 0;
+    a.color[1] = 0;
+    a.site[1] = 0;
+    a.setVertical(1, FLT_MAX);
 }
 
-float VoronoiRasterizer::computeLiveMaxDist(size_t& n) const {
-    VoronoiSegment* i = leftDummy.next;
-    VoronoiSegment* k = rightDummy.prev;
-    Assert(i!=&rightDummy);
-    Assert(k!=&leftDummy);
-    // Special rules apply to leftmost and rightmost real segments.
-    float maxD2 = Max(Dist2(i->x, i->y, minX, lineY),
-        Dist2(k->x, k->y, maxX, lineY));
-    float count = 1;
-    while (i!=k) {
-        i = i->next;
-        float d2 = Dist2(i->x, i->y, i->left, lineY);
-        if (d2>maxD2)
+void VoronoiRasterizer::recomputeLiveMaxDist2() {
+    const LiveArrays& a = *live;
+    // Left end of the leftmost real segment is at minX.
+    size_t m = 1;
+    float maxD2 = leftDist2(a, 1);
+    for (size_t i=2; i<=liveSize-2; ++i) {
+        float d2 = leftDist2(a, i);
+        if (d2>maxD2) {
             maxD2 = d2;
-        ++count;
+            m = i;
+        }
     }
-    n = count;
+    liveMaxDist2 = maxD2;
+    liveMaxIndex = m;
+}
+
+float VoronoiRasterizer::computeLiveMaxDist(size_t& n) {
+    const LiveArrays& a = *live;
+    // Index of last real segment
+    const size_t k = liveSize-2;
+    Assert(k>=1);
+    if (!liveMaxIndex)
+        recomputeLiveMaxDist2();
+    Assert(1<=liveMaxIndex && liveMaxIndex<=k);
+    Assert(leftDist2(a, liveMaxIndex)==liveMaxDist2);
+#if ASSERTIONS
+    for (size_t i=1; i<=k; ++i)
+        Assert(leftDist2(a, i)<=liveMaxDist2);
+#endif /* ASSERTIONS */
+    // The right end of the rightmost real segment is at maxX.  It is not a left end, so it is not tracked.
+    float maxD2 = Max(liveMaxDist2, Dist2(a.x[k], a.y[k], maxX, lineY));
+    n = k;
     return std::sqrt(maxD2);
 }
 
-bool VoronoiRasterizer::processTriplet(const Point& i, const Ant& j, const Point& k) {
+bool VoronoiRasterizer::processTriplet(const Point& i, const Ant* site, const Point& k) {
+    const Ant& j = *site;
     Assert(i.x<=j.x);
     Assert(j.x<=k.x);
     float o;
@@ -441,262 +779,1480 @@ bool VoronoiRasterizer::processTriplet(const Point& i, const Ant& j, const Point
             return false;
         // lineY < o < j.y.  Cell for j is convex-down and below current scan line.  Defer j
     }
-    defer(j, o);
+    defer(site, o);
     return true;
 }
 
-void VoronoiRasterizer::setBoundary(const Point& l, VoronoiSegment& r) const {
+void VoronoiRasterizer::setBoundary(const Point& l, LiveArrays& a, size_t k) const {
+    const Point r = a.point(k);
     Assert(l.x<r.x);
     if (l.x==-FLT_MAX) {
-        r.left = minX;
-        r.slope = 0;
+        a.setVertical(k, minX);
     } else if (r.x==FLT_MAX) {
-        r.left = maxX;
-        r.slope = 0;
+        a.setVertical(k, maxX);
     } else {
         // Compute slope with respect to y-axis of perpendicular bisector of l--r
         float slope = (l.y-r.y)/(r.x-l.x);
-        r.slope = slope;
-        // Compute intersection with current y
-        r.left = 0.5f*((l.x+r.x) + slope*(2.0f*lineY-(l.y+r.y)));
+        // Bisector passes through midpoint of l--r
+        float anchorX = 0.5f*(l.x+r.x);
+        float anchorY = 0.5f*(l.y+r.y);
+#if FIXED_POINT_BOUNDARY
+        a.slope[k] = ToBoundary(Clip(-boundarySlopeMax, boundarySlopeMax, slope));
+        // Compute in double so that base depends only on l and r.  The result is needed only modulo 2^64.
+        a.base[k] = uint64_t(std::llround(double(anchorX)*boundaryScale - double(a.slope[k])*anchorY));
+#else
+        a.slope[k] = slope;
+        a.anchorX[k] = anchorX;
+        a.anchorY[k] = anchorY;
+#endif
+        // Compute intersection with current y.  The clamped slope is good only for stepping.
+#if FIXED_POINT_BOUNDARY
+        a.left[k] = a.isSteep(k) ? ExactBisectorBoundary(l, r, lineY) : a.leftAt(k, lineY);
+#else
+        a.left[k] = a.leftAt(k, lineY);
+#endif
         // Check for culling errors
-        Assert(-RegionSegment::valueTypeMax < r.left);
-        Assert(r.left < RegionSegment::valueTypeMax);
+        Assert(-RegionSegment::valueTypeMax < BoundaryToFloat(a.left[k]));
+        Assert(BoundaryToFloat(a.left[k]) < RegionSegment::valueTypeMax);
     }
-#if ASSERTIONS
-    r.yWhenSlopeWasSet = lineY;
-    r.originalLeft = r.left;
-#endif /* ASSERTIONS */
 }
 
-void VoronoiRasterizer::forceBoundaryOrder(VoronoiSegment& j) const {
-    float array[4] ={ j.prev->left,j.left,j.next->left,1.0E6 };
-    if (j.next->next) {
-        array[3] = j.next->next->left;
-    }
-
-    VoronoiSegment& k = *j.next;
-    if (j.left>k.left) {
-        Assert(j.left-k.left <= 0.125f);
+void VoronoiRasterizer::forceBoundaryOrder(LiveArrays& out, size_t jIndex, LiveArrays& in, size_t kIndex, size_t inSize) {
+    const Boundary iLeft = out.left[jIndex-1];
+    Boundary& jLeft = out.left[jIndex];
+    Boundary& kLeft = in.left[kIndex];
+    if (jLeft>kLeft) {
+        Assert(jLeft-kLeft <= ToBoundary(0.125f));
         // Segment j is backwards.  
         // Use "left" of neighbor with smallest slope, since it's likely to be the most accurate.
-        j.left = k.left = fabs(j.slope)<fabs(k.slope) ? j.left : k.left;
+        jLeft = kLeft = std::abs(out.slope[jIndex])<std::abs(in.slope[kIndex]) ? jLeft : kLeft;
     }
-    VoronoiSegment& i = *j.prev;
-    if (i.left>j.left) {
+    if (iLeft>jLeft) {
         // Segment i is backwards.  
-        Assert(i.left-j.left <= 0.25f || TolerateRoundoffErrors);
-        j.left = i.left;
-        if (j.left>k.left) {
-            Assert(j.left-k.left <= 0.0001f);
-            k.left = j.left;
+        Assert(iLeft-jLeft <= ToBoundary(0.25f) || TolerateRoundoffErrors);
+        jLeft = iLeft;
+        if (jLeft>kLeft) {
+            Assert(jLeft-kLeft <= ToBoundary(0.0001f));
+            kLeft = jLeft;
         }
     }
-    if (VoronoiSegment* l = k.next) {
-        if (k.left>l->left) {
+    if (kIndex+1<inSize) {
+        const Boundary lLeft = in.left[kIndex+1];
+        if (kLeft>lLeft) {
             // Segment k is backwards. 
-            Assert(k.left-l->left <= 0.60f || TolerateRoundoffErrors);
-            k.left = l->left;
-            if (j.left>k.left) {
-                Assert(j.left-k.left < 0.0001f);
-                j.left = k.left;
+            Assert(kLeft-lLeft <= ToBoundary(0.60f) || TolerateRoundoffErrors);
+            kLeft = lLeft;
+            if (jLeft>kLeft) {
+                Assert(jLeft-kLeft < ToBoundary(0.0001f));
+                jLeft = kLeft;
             }
         }
     }
-    Assert(i.left<=j.left);
-    Assert(j.left<=k.left);
+    Assert(iLeft<=jLeft);
+    Assert(jLeft<=kLeft);
 }
 
-void VoronoiRasterizer::mergeIntoEmptyLive(const Ant& j) {
+void VoronoiRasterizer::mergeIntoEmptyLive(const Ant* j) {
     Assert(liveIsEmpty());
-    VoronoiSegment* s = insert(&leftDummy, &rightDummy);
-    s->assign(j);
-    setBoundary(leftDummy, *s);
-    setBoundary(*s, rightDummy);
+    LiveArrays& a = *live;
+    // Move right dummy over to make room for j
+    a.copy(2, a, 1);
+    a.assign(1, j, j-antFirst);
+    liveSize = 3;
+    ++buffer.stats.count[VoronoiStat::antsInserted];
+    liveMaxIndex = 0;
+    setBoundary(a.point(0), a, 1);
+    setBoundary(a.point(1), a, 2);
     Assert(assertLiveIsOkay());
 }
 
 void VoronoiRasterizer::mergeFrontierIntoLive() {
-    STAT(mergeCount++);
-    STAT(liveTotal+=liveLast-liveFirst);
-    STAT(frontierTotal+=frontierLast-frontierFirst);
-    STAT(emptyFrontierCount+=(frontierLast==frontierFirst));
-    std::sort(frontierFirst, frontierLast, Ant::lessX());
     Assert(assertLiveIsOkay());
-    VoronoiSegment* i = &leftDummy;
-    for (Ant* j = frontierFirst; j!=frontierLast; ++j) {
-        VoronoiSegment* k;
-        // Advance i (and compute k) so that i->x <= j->x <= k->x
-        while (j->x >= (k=i->next)->x)
-            i=k;
-        Assert(i->x <= j->x);
-        Assert(j->x < k->x);
-        if (!processTriplet(*i, *j, *k)) {
+    if (frontierIsEmpty())
+        return;
+    ++buffer.stats.count[VoronoiStat::merges];
+    frontierSorter.sort(frontierFirst, frontierLast, [](const Ant* a) {return a->x; });
+    // Segments are merged into "out".  Segment out[n-1] is the rightmost segment so far, and plays the role of "i".
+    // Segment in[k] is the leftmost segment not yet copied to out, and plays the role of "k".
+    // Squashing a segment to the left of the new one pops it from out; squashing one to the right skips it in "in".
+    LiveArrays& in = *live;
+    LiveArrays& out = *spare;
+    const size_t inSize = liveSize;
+    size_t n = 1;
+    size_t k = 1;
+    // Boundary that attained liveMaxDist2, as an index into "in" until it is copied and into "out" afterwards.
+    // Zero if the boundary is gone or changed, in which case liveMaxDist2 is recomputed later.
+    size_t maxIn = liveMaxIndex;
+    size_t maxOut = 0;
+    // inserted[0..nInserted) are indices into out of inserted segments, in increasing order.
+    size_t nInserted = 0;
+    for (const Ant** f = frontierFirst; f!=frontierLast; ++f) {
+        const Ant* j = *f;
+        // Copy segments so that out[n-1].x <= j->x < in[k].x
+        size_t m = k;
+        while (j->x >= in.x[m])
+            ++m;
+        out.copy(n, in, k, m-k);
+        if (k<=maxIn && maxIn<m)
+            maxOut = n+(maxIn-k);
+        n += m-k;
+        k = m;
+        Assert(out.x[n-1] <= j->x);
+        Assert(j->x < in.x[k]);
+        if (!processTriplet(out.point(n-1), j, in.point(k))) {
             // j should be inserted.  
             // See what it squashes/defers to its left
-            if (i->x == j->x) {
-                // Perpendicular bisector of i--j is horizontal.  Since j is being inserted, i must be removed.
-                // FIXME - if two points are identical, have deterministic rule to resolve the fight
-                if (i->y>j->y) {
-                    defer(*i, (i->y+j->y)*0.5f);
+            if (out.x[n-1] == j->x) {
+                // Perpendicular bisector of i--j is horizontal.  The site below it owns the current scan line iff
+                // the bisector is above the line.  Sites a few ulps apart can get here with the bisector on the wrong
+                // side of the line because of roundoff in processTriplet.  Then i keeps the line, not j.
+                const float mid = (out.y[n-1]+j->y)*0.5f;
+                if (out.y[n-1]>j->y) {
+                    if (mid<lineY)
+                        // j is above i, and its cell ends above the current scan line.
+                        continue;
+                    defer(siteOf(out, n-1), mid);
+                } else if (out.y[n-1]<j->y && mid>lineY) {
+                    // j is below i, and its cell starts below the current scan line.
+                    defer(j, mid);
+                    continue;
                 }
-                i=i->prev;
+                // Since j is being inserted, i must be removed.
+                --n;
             }
-            while (i!=&leftDummy && processTriplet(*i->prev, *i, *j))
-                i=i->prev;
+            while (n>1 && processTriplet(out.point(n-2), siteOf(out, n-1), *j))
+                --n;
+            // Forget squashed segments
+            if (maxOut>=n)
+                maxOut = 0;
+            while (nInserted>0 && inserted[nInserted-1]>=n)
+                --nInserted;
             // See what it squashes/defers to its right
-            while (k!=&rightDummy && processTriplet(*j, *k, *k->next))
-                k=k->next;
-            Assert(i->x < j->x);
-            Assert(j->x < k->x);
-            VoronoiSegment* s = replaceSegmentsBetweenWithNewSegment(i, k);
-            s->assign(*j);
-            setBoundary(*i, *s);
-            setBoundary(*s, *k);
-            forceBoundaryOrder(*s);
-            Assert(assertLiveIsOkay());
-            i = s;
+            while (k+1<inSize && processTriplet(*j, siteOf(in, k), in.point(k+1)))
+                ++k;
+            Assert(out.x[n-1] < j->x);
+            Assert(j->x < in.x[k]);
+            out.assign(n, j, j-antFirst);
+            setBoundary(out.point(n-1), out, n);
+            setBoundary(*j, in, k);
+            if (k==maxIn)
+                maxIn = 0;
+            forceBoundaryOrder(out, n, in, k, inSize);
+            inserted[nInserted++] = uint32_t(n);
+            ++n;
+            ++buffer.stats.count[VoronoiStat::antsInserted];
         }
     }
+    // Copy remaining segments
+    out.copy(n, in, k, inSize-k);
+    if (k<=maxIn)
+        maxOut = n+(maxIn-k);
+    n += inSize-k;
+    std::swap(live, spare);
+    liveSize = n;
     frontierLast = frontierFirst;
+    if (maxOut && maxOut<n-1) {
+        // The maximum survived.  New boundaries are those on either side of an inserted segment.
+        liveMaxIndex = maxOut;
+        for (size_t i=0; i<nInserted; ++i)
+            for (size_t b=inserted[i]; b<=inserted[i]+1 && b<n-1; ++b) {
+                float d2 = leftDist2(out, b);
+                if (d2>liveMaxDist2) {
+                    liveMaxDist2 = d2;
+                    liveMaxIndex = b;
+                }
+            }
+    } else {
+        liveMaxIndex = 0;
+    }
+    Assert(assertLiveIsOkay());
 }
 
-void VoronoiRasterizer::drawLive(NimblePixMap& window, const CompoundRegion& region) {
+template<typename Shape, typename SpanSink>
+void VoronoiRasterizer::drawLive(SpanSink& sink, const Shape& shape) {
     Assert(assertLiveIsOkay());
-    Assert(-region.lineWidth<=minX);
-    Assert(maxX<=window.width()+region.lineWidth);
-    Assert(-region.lineWidth<=minY);
-    Assert(minY<=window.height()+region.lineWidth);
+    Assert(-shape.lineWidth()<=minX);
+    Assert(-shape.lineWidth()<=minY);
 
     // FIXME - do not do infill.  That needs to be done after all Voronoi regions are drawn.
     // FIXME - split out advancement to next line to separate routine
     // FIXME compute maxDist2 after update
-    RegionSegment* s = region.begin(lineY);
-    RegionSegment* e = region.end(lineY);
+    const RegionSegment* s = shape.begin(lineY);
+    const RegionSegment* e = shape.end(lineY);
     Assert(s<e); // Caller should reject empty scan lines
-    VoronoiSegment* j = leftDummy.next;
+    const int y = lineY;
+    const LiveArrays& a = *live;
+    // Index of right dummy
+    const size_t last = liveSize-1;
+    VoronoiStats& stats = buffer.stats;
+    stats.count[VoronoiStat::liveMax] = Max<uint64_t>(stats.count[VoronoiStat::liveMax], liveSize-2);
+    size_t nSpan = 0;
+    size_t j = 1;
     for (;;) {
         Assert(s->left < s->right);
-        Assert(-RegionSegment::valueTypeMax <= j->left);
-        Assert(j->left <= RegionSegment::valueTypeMax);
-        RegionSegment::valueType l=j->left;
-        RegionSegment::valueType r=j->next->left;
+        Assert(-RegionSegment::valueTypeMax <= BoundaryToFloat(a.left[j]));
+        Assert(BoundaryToFloat(a.left[j]) <= RegionSegment::valueTypeMax);
+        // Conversion is a shift when boundaries are fixed-point.
+        RegionSegment::valueType l=BoundaryToInt(a.left[j]);
+        RegionSegment::valueType r=BoundaryToInt(a.left[j+1]);
         int u = Max(s->left, l);
-        auto c = j->color;
         int v = Min(s->right, r);
-        if (j->outlineId != Outline::idType::null) {
-            if (u<v)
-                Outline::addSegment(j->outlineId, u, v, lineY, c);
-        } else if (unsigned(lineY)<unsigned(window.height())) {
-            if (u<0)
-                // FIXME - assert that we're dealing with outlined diagram
-                u = 0;
-            if (v>=window.width())
-                // FIXME - assert that we're dealing with outlined diagram
-                v = window.width();
-            if (u<v) {
-                NimblePixel* out = (NimblePixel*)window.at(u, lineY);
-                do {
-                    *out++ = c.interior();
-                } while (++u<v);
-            }
-        }
-        if (j->next->left>=s->right) {
+        // Empty spans are passed on, because testing for them here costs more than letting the sink do it.
+        sink.addSpan(y, u, v, a.site[j], a.color[j]);
+        ++nSpan;
+        if (a.left[j+1]>=ToBoundary(s->right)) {
             // Current Voronoi segment reached end of current RegionSegment
-            if (++s==e)
+            if (Shape::oneSegmentPerLine || ++s==e)
                 break;
         } else {
             // Current VoronoiSegment did not reach end of current RegionSegment
-            j = j->next;
-            if (j==&rightDummy)
+            if (++j==last)
                 break;
         }
     }
+    stats.count[VoronoiStat::spans] += nSpan;
 }
 
 void VoronoiRasterizer::advanceLive() {
     Assert(assertLiveIsOkay());
-    Assert(leftDummy.next->slope==0);
+    LiveArrays& a = *live;
+    const size_t n = liveSize;
+    Assert(n==2 || a.slope[1]==0);
     lineY += 1;
-    for (VoronoiSegment* j = leftDummy.next; VoronoiSegment* k = j->next; j=k) {
-        k->left += k->slope;
-        while (j->left >= k->left) {
-            // j is squashed
-            VoronoiSegment* i = j->prev;
-            erase(i, k);
-            setBoundary(*i, *k);
-            j = i;
+    liveMaxIndex = 0;
+    // Step every boundary.  The iterations are independent, so the compiler can vectorize the loop.
+#if FIXED_POINT_BOUNDARY
+    bool steep = false;
+    for (size_t k=2; k<n; ++k) {
+        a.left[k] = a.leftAt(k, lineY);
+        steep |= a.isSteep(k);
+    }
+    // Stepping with a clamped slope is inexact, so recompute those boundaries.  Segment k-1 is the left neighbor of k.
+    if (steep)
+        for (size_t k=2; k<n; ++k)
+            if (a.isSteep(k))
+                a.left[k] = ExactBisectorBoundary(a.point(k-1), a.point(k), lineY);
+#else
+    for (size_t k=2; k<n; ++k)
+        a.left[k] = a.leftAt(k, lineY);
+#endif
+    // Find first segment that was squashed, if any.
+    size_t k = 2;
+    while (k<n && a.left[k-1]<a.left[k])
+        ++k;
+    if (k<n) {
+        // Remove squashed segments, compacting in place.  Segment a[m-1] plays the role of "j".
+        size_t m = k;
+        for (; k<n; ++k) {
+            while (a.left[m-1] >= a.left[k]) {
+                // j is squashed
+                --m;
+                setBoundary(a.point(m-1), a, k);
+            }
+            a.copy(m++, a, k);
         }
-        Assert(j->next==k);
+        liveSize = m;
     }
     Assert(assertLiveIsOkay());
 }
 
-} // (anonymous)
-
-//! Draw Voronoi diagram on the given window within the given region, using Ants in [antFirst,antLast).
-void DrawVoronoi(NimblePixMap& window, const CompoundRegion& region, Ant* antFirst, Ant* antLast) {
-    Assert(antFirst+3<=antLast); // Must have at least two bookends and one ant
-    Assert(antLast-antFirst <= N_ANT_MAX+2);
-    Assert(antFirst[0].y == -AntInfinity);
-    Assert(antLast[-1].y == AntInfinity);
-    Assert(region.bottom() <= window.height()+region.lineWidth);
-    Assert(region.assertOkay());
-#if ASSERTIONS
-    for (Ant* a = antFirst+1; a<antLast-1; ++a) {
-        Assert(a->y>-AntInfinity);
-        Assert(a->y<AntInfinity);
-    }
-#endif
-    std::sort(antFirst+1, antLast-1, Ant::lessY());
-
-    size_t nAnt = (antLast-antFirst)-2;
-
-    static VoronoiRasterizer::bufferType buffer;
-    VoronoiRasterizer v(buffer);
-    v.setBoundingBox(region);
-    Outline::start();
-
+template<typename Shape, typename SpanSink>
+void VoronoiRasterizer::sweep(SpanSink& sink, const Shape& shape, const Ant* antLast, int yFirst, int yLast) {
+    Assert(liveIsEmpty());
+    Assert(skip);
+    startBuckets(yFirst, yLast);
     // Start with Ant closest to scan line
     WalkByY yOrder;
 
     // For each scan line
-    for (int lineY=v.top(); lineY<=v.bottom(); ++lineY) {
+    for (int y=yFirst; y<=yLast; ++y) {
 
         // FIXME - move this line before loop, because "advanceLive" makes it redundant here
-        v.setLine(lineY);
-        if (!region.empty(lineY)) {
+        setLine(y);
+        if (!shape.empty(y)) {
 
-            if (v.liveIsEmpty()) {
+            if (liveIsEmpty()) {
                 // Starting from scratch.  
-                v.mergeIntoEmptyLive(yOrder.startWalk(lineY, antFirst, antLast));
+                mergeIntoEmptyLive(&yOrder.startWalk(y, antFirst, antLast, skip));
             }
-            v.popHeapToFrontier(lineY);
+            popBucketsToFrontier(y);
             bool endOfIncoming = false;
             for (;;) {
                 // Following step is required even if frontier is empty, so that "left" field is computed for each segment.
-                v.mergeFrontierIntoLive();
+                mergeFrontierIntoLive();
                 if (endOfIncoming) break;
                 size_t n;
-                float d = v.computeLiveMaxDist(n);
+                float d = computeLiveMaxDist(n);
                 for (; n>0; --n) {
-                    const Ant* a = yOrder.getNextAboveOrBelowIf(lineY, d);
+                    const Ant* a = yOrder.getNextAboveOrBelowIf(y, d);
                     if (!a) {
                         endOfIncoming = true;
                         break;
                     }
-                    v.appendToFrontier(*a);
+                    appendToFrontier(a);
+                }
+                if (frontierIsEmpty())
+                    break;
+            }
+            drawLive(sink, shape);
+            ++buffer.stats.count[VoronoiStat::linesSwept];
+        } else {
+            ++buffer.stats.count[VoronoiStat::linesEmpty];
+        }
+        advanceLive();
+    }
+}
+
+void VoronoiRasterizer::markSites(uint32_t* mark) const {
+    const LiveArrays& a = *live;
+    for (size_t k=1; k+1<liveSize; ++k)
+        mark[a.site[k]] = 1;
+    for (int y=bucketNext; y<=bucketLast && y-bucketNext<N_BUCKET_MAX; ++y)
+        for (const DeferredAnt* d = bucketAt(y); d; d=d->next)
+            mark[d->site-antFirst] = 1;
+}
+
+void VoronoiRasterizer::reserve(size_t n) {
+    Assert(frontierIsEmpty());
+    if (n<=buffer.frontier.size())
+        return;
+    // Deferred Ants are linked by pointers, so they are copied bucket by bucket into a new array.
+    std::vector<DeferredAnt> deferred(RoundUpToPowerOfTwo(n));
+    DeferredAnt* p = deferred.data();
+    for (int y=bucketNext; y<=bucketLast && y-bucketNext<N_BUCKET_MAX; ++y) {
+        DeferredAnt** link = &bucketAt(y);
+        for (const DeferredAnt* d = *link; d; d=d->next) {
+            p->site = d->site;
+            *link = p;
+            link = &p->next;
+            ++p;
+        }
+        *link = nullptr;
+    }
+    const size_t nDeferred = p-deferred.data();
+    buffer.deferred.swap(deferred);
+    buffer.reserve(n);
+    bindBuffer();
+    deferredFreePtr = deferredFirst+nDeferred;
+    deferredFreeList = nullptr;
+}
+
+void VoronoiRasterizer::moveSites(const Ant* newFirst, const uint32_t* newIndex) {
+    Assert(frontierIsEmpty());
+    LiveArrays& a = *live;
+    for (size_t k=1; k+1<liveSize; ++k)
+        a.site[k] = newIndex[a.site[k]];
+    for (int y=bucketNext; y<=bucketLast && y-bucketNext<N_BUCKET_MAX; ++y)
+        for (DeferredAnt* d = bucketAt(y); d; d=d->next)
+            d->site = newFirst+newIndex[d->site-antFirst];
+    antFirst = newFirst;
+}
+
+//! Window on a stream of Ants sorted by y, for DrawVoronoiStream.
+/** Ants are read from the stream into a buffer as they are needed.  When the buffer is full, Ants that the rasterizer
+    no longer refers to are discarded, so the buffer stays proportional to what the rasterizer refers to. */
+class AntStream {
+    //! buffer[0] is a bookend for the dummy segments.  [1,head) have been pulled.  [head,size) have been read but not pulled.
+    std::vector<Ant> buffer;
+    //! Buffer that "buffer" is compacted into.  Swapped with it afterwards.
+    std::vector<Ant> spare;
+    //! Maps index of a pulled Ant in buffer to its index after compaction.
+    std::vector<uint32_t> newIndex;
+    size_t head;
+    size_t size;
+    const std::function<size_t(Ant*, size_t)>& readAnts;
+    bool atEnd;
+
+    //! Read more Ants into buffer.  Return false if there is no room or the stream has ended.
+    bool read() {
+        Assert(head==size);
+        if (atEnd || size==buffer.size())
+            return false;
+        const size_t n = readAnts(buffer.data()+size, buffer.size()-size);
+        Assert(n<=buffer.size()-size);
+#if ASSERTIONS
+        for (size_t i=size; i<size+n; ++i) {
+            Assert(std::fabs(buffer[i].y)<AntInfinity);
+            Assert(i==1 || buffer[i-1].y<=buffer[i].y);
+        }
+#endif
+        size += n;
+        atEnd = n==0;
+        return n>0;
+    }
+public:
+    AntStream(const std::function<size_t(Ant*, size_t)>& readAnts_, size_t capacity) :
+        buffer(capacity),
+        head(1),
+        size(1),
+        readAnts(readAnts_),
+        atEnd(false) {
+        Assert(capacity>=2);
+        buffer[0].assignFirstBookend();
+    }
+
+    const Ant* first() const { return buffer.data(); }
+
+    //! Pull next Ant if it is above y or less than d below y.  Return NULL if there is no such Ant or no room for it.
+    const Ant* pullIf(float y, float d) {
+        if (head==size && !read())
+            return nullptr;
+        const Ant* a = &buffer[head];
+        if (a->y-y<d) {
+            ++head;
+            return a;
+        }
+        return nullptr;
+    }
+
+    //! True if Ants remain in the stream but there is no room to read them.
+    bool isFull() const {
+        return head==size && size==buffer.size() && !atEnd;
+    }
+
+    //! If the buffer is full, discard pulled Ants that v no longer refers to, and grow the buffer if that frees too little.
+    /** v's frontier must be empty. */
+    void makeRoom(VoronoiRasterizer& v) {
+        if (!isFull())
+            return;
+        newIndex.assign(head, 0);
+        newIndex[0] = 1;
+        v.markSites(newIndex.data());
+        size_t m = 0;
+        for (size_t i=0; i<head; ++i)
+            if (newIndex[i])
+                newIndex[i] = uint32_t(m++);
+        // Grow if less than half the buffer would be free.
+        spare.resize(2*m>buffer.size() ? 2*buffer.size() : buffer.size());
+        // Only the bookend maps to index 0.
+        for (size_t i=0; i<head; ++i)
+            if (newIndex[i] || i==0)
+                spare[newIndex[i]] = buffer[i];
+        v.moveSites(spare.data(), newIndex.data());
+        v.reserve(spare.size());
+        buffer.swap(spare);
+        head = size = m;
+    }
+};
+
+template<typename SpanSink>
+void VoronoiRasterizer::sweepStream(SpanSink& sink, const RectangleShape& shape, AntStream& stream) {
+    Assert(liveIsEmpty());
+    Assert(antFirst==stream.first());
+    Assert(shape.top()==0);
+    const int height = shape.bottom();
+    startBuckets(0, height-1);
+    for (int y=0; y<height; ++y) {
+        setLine(y);
+        if (liveIsEmpty())
+            // Starting from scratch.  Stay empty if the stream is empty.
+            if (const Ant* a = stream.pullIf(y, AntInfinity))
+                mergeIntoEmptyLive(a);
+        if (!liveIsEmpty()) {
+            popBucketsToFrontier(y);
+            bool endOfIncoming = false;
+            for (;;) {
+                mergeFrontierIntoLive();
+                if (endOfIncoming) break;
+                size_t n;
+                float d = computeLiveMaxDist(n);
+                stream.makeRoom(*this);
+                // Ants above the scan line are always pulled, because the stream cannot be revisited.
+                // On the first scan line, that pulls every Ant above the image.
+                for (; n>0; --n) {
+                    const Ant* a = stream.pullIf(y, d);
+                    if (!a) {
+                        // If the buffer is full, pull more after the next merge makes room.
+                        endOfIncoming = !stream.isFull();
+                        break;
+                    }
+                    appendToFrontier(a);
+                }
+                if (frontierIsEmpty())
+                    break;
+            }
+            drawLive(sink, shape);
+            ++buffer.stats.count[VoronoiStat::linesSwept];
+        } else {
+            ++buffer.stats.count[VoronoiStat::linesEmpty];
+        }
+        sink.finishRow(y);
+        advanceLive();
+    }
+}
+
+//! SpanSink that fills interiors of cells in a window and records spans of outlined cells for Outline.
+/** A SpanSink receives each maximal run [left,right) of scan line y that is closest to a single site.
+    The site is identified by its index in the buffer of Ants being swept.
+    Spans may be empty.  If Clip is true, spans may extend beyond the window by up to the region's lineWidth.
+    If Outlined is false, no cell has an exterior color, and there is no Outline::Stripe. */
+template<bool Outlined, bool Clip>
+class PixelSpanSink {
+    NimblePixMap& myWindow;
+    Outline::Stripe* myOutline;
+    //! Added to the index of a cell to get its Outline id.
+    size_t myIdBase;
+public:
+    PixelSpanSink(NimblePixMap& window, Outline::Stripe* outline, size_t idBase=0) : myWindow(window), myOutline(outline), myIdBase(idBase) {
+        Assert(Outlined==(outline!=nullptr));
+    }
+    void addSpan(int y, int left, int right, size_t cellIndex, OutlinedColor color) {
+        Assert(Outlined || !color.hasExterior());
+        if (Outlined && color.hasExterior()) {
+            if (left<right)
+                myOutline->addSegment(Outline::idOfAnt(myIdBase+cellIndex), left, right, y, color);
+        } else if (!Clip || unsigned(y)<unsigned(myWindow.height())) {
+            if (Clip) {
+                if (left<0)
+                    // FIXME - assert that we're dealing with outlined diagram
+                    left = 0;
+                if (right>=myWindow.width())
+                    // FIXME - assert that we're dealing with outlined diagram
+                    right = myWindow.width();
+            } else {
+                Assert(unsigned(y)<unsigned(myWindow.height()));
+                Assert(0<=left || right<=left);
+                Assert(right<=myWindow.width() || right<=left);
+            }
+            if (left<right) {
+                NimblePixel* out = (NimblePixel*)myWindow.at(left, y);
+                do {
+                    *out++ = color.interior();
+                } while (++left<right);
+            }
+        }
+    }
+};
+
+//! SpanSink that fills a row of pixels with interior colors of cells, and passes each finished row on.
+class RowSpanSink {
+    std::vector<NimblePixel> myRow;
+    const std::function<void(int, const NimblePixel*)>& myPutRow;
+public:
+    RowSpanSink(int width, const std::function<void(int, const NimblePixel*)>& putRow) : myRow(width), myPutRow(putRow) {}
+    void addSpan(int /*y*/, int left, int right, size_t /*cellIndex*/, OutlinedColor color) {
+        Assert(0<=left || right<=left);
+        Assert(right<=int(myRow.size()) || right<=left);
+        for (; left<right; ++left)
+            myRow[left] = color.interior();
+    }
+    void finishRow(int y) {
+        myPutRow(y, myRow.data());
+    }
+};
+
+//! Buffers for the rasterizers of the stripes.  Allocated on first use.
+std::unique_ptr<VoronoiRasterizer::bufferType> RasterizerBuffers[N_WORKER_MAX];
+
+//! Buffer for the rasterizer of stripe k.
+VoronoiRasterizer::bufferType& RasterizerBuffer(size_t k) {
+    Assert(k<N_WORKER_MAX);
+    if (!RasterizerBuffers[k])
+        RasterizerBuffers[k].reset(new VoronoiRasterizer::bufferType);
+    return *RasterizerBuffers[k];
+}
+
+//! Counts of the most recent call.
+VoronoiStats LastStats;
+
+//! Sum of counts since TakeVoronoiFrameStats was last called.
+VoronoiStats FrameStats;
+
+//! Count n Ants, not counting bookends, as passed in to the current call.
+void CountAntsIn(size_t n) {
+    RasterizerBuffer(0).stats.count[VoronoiStat::antsIn] += n;
+}
+
+//! Count work done by Outline.  Must be called after Outline::finishAndDraw.
+void CountOutline() {
+    const Outline::Stats& s = Outline::lastStats();
+    VoronoiStats& stats = RasterizerBuffer(0).stats;
+    stats.count[VoronoiStat::outlineSegments] += s.segments;
+    stats.count[VoronoiStat::outlineIds] += s.ids;
+    stats.count[VoronoiStat::outlineGrowths] += s.growths;
+}
+
+//! Collect the counts of the current call from the buffers.  Called at the end of each public routine that draws.
+void FinishStats() {
+    LastStats.clear();
+    for (auto& b: RasterizerBuffers)
+        if (b) {
+            LastStats += b->stats;
+            b->stats.clear();
+        }
+    FrameStats += LastStats;
+}
+
+//! Number of stripes to split scan lines [top,bottom] into.
+size_t StripeCount(int top, int bottom) {
+    // Each stripe of scan lines is swept independently, starting from an empty live list.
+    // Stripes shorter than this are not worth the cost of seeding the live list.
+    constexpr int minStripeHeight = 64;
+    const int height = bottom-top+1;
+    return Max(Min<int>(WorkerCount(), height/minStripeHeight), 1);
+}
+
+//! Sweep region in nStripe stripes, using Ants in [antFirst,antLast), which must be sorted by y.
+/** Rasterizer v must be for stripe 0 and have its bounding box set.
+    Spans of stripe k are sent to the SpanSink returned by makeSink(k). */
+template<typename Shape, typename MakeSink>
+void SweepStripes(VoronoiRasterizer& v, const Shape& shape, const Ant* antFirst, const Ant* antLast, size_t nStripe, MakeSink makeSink) {
+    const int top = v.top();
+    const int bottom = v.bottom();
+    const int height = bottom-top+1;
+    // Stripe k sweeps scan lines [yFirst(k),yFirst(k+1)-1]
+    auto yFirst = [=](size_t k) {return top + int(height*k/nStripe); };
+    if (nStripe==1) {
+        auto sink = makeSink(0);
+        v.sweep(sink, shape, antLast, top, bottom);
+    } else {
+        for (size_t k=1; k<nStripe; ++k)
+            RasterizerBuffer(k);
+        ParallelFor(nStripe, [&](size_t k) {
+            auto sink = makeSink(k);
+            if (k==0) {
+                v.sweep(sink, shape, antLast, yFirst(0), yFirst(1)-1);
+            } else {
+                VoronoiRasterizer w(RasterizerBuffer(k), antFirst, antLast-antFirst, v.skipMarks());
+                w.setBoundingBox(v.boundingBox());
+                w.sweep(sink, shape, antLast, yFirst(k), yFirst(k+1)-1);
+            }
+        });
+    }
+}
+
+//! SpanSink that ignores spans.
+class NullSpanSink {
+public:
+    void addSpan(int /*y*/, int /*left*/, int /*right*/, size_t /*cellIndex*/, OutlinedColor /*color*/) {}
+};
+
+//! SpanSink that writes the index of each span's cell into a VoronoiIdMap, and passes the span on to another SpanSink.
+template<typename T, typename SpanSink>
+class IdSpanSink {
+    SpanSink myInner;
+    const VoronoiIdMap<T>& myMap;
+    //! If not null, bit i is set when cell i writes a pixel.
+    uint64_t* myVisible;
+public:
+    IdSpanSink(const SpanSink& inner, const VoronoiIdMap<T>& map, uint64_t* visible) : myInner(inner), myMap(map), myVisible(visible) {}
+    void addSpan(int y, int left, int right, size_t cellIndex, OutlinedColor color) {
+        myInner.addSpan(y, left, right, cellIndex, color);
+        if (unsigned(y)<unsigned(myMap.height)) {
+            left = Max(left, 0);
+            right = Min(right, myMap.width);
+            if (left<right) {
+                T* row = myMap.ids+y*myMap.pitch;
+                std::fill(row+left, row+right, T(cellIndex));
+                if (myVisible)
+                    myVisible[cellIndex>>6] |= uint64_t(1)<<(cellIndex&63);
+            }
+        }
+    }
+};
+
+//! Bit sets of cells that wrote a pixel, one per stripe, that are combined into the visible set of a VoronoiIdMap.
+class VisibleSet {
+    std::vector<uint64_t> myBits[N_WORKER_MAX];
+public:
+    //! Clear and return the bit set for stripe k of a diagram with n Ants.
+    uint64_t* stripe(size_t k, size_t n) {
+        Assert(k<N_WORKER_MAX);
+        myBits[k].assign((n+63)/64, 0);
+        return myBits[k].data();
+    }
+    //! Set visible to the indices of bits set by any stripe, in increasing order, and forget the bit sets.
+    void collect(std::vector<uint32_t>& visible) {
+        visible.clear();
+        size_t m = 0;
+        for (const std::vector<uint64_t>& b: myBits)
+            m = Max(m, b.size());
+        for (size_t i=0; i<m; ++i) {
+            uint64_t w = 0;
+            for (const std::vector<uint64_t>& b: myBits)
+                if (i<b.size())
+                    w |= b[i];
+            for (; w; w &= w-1) {
+                unsigned j = 0;
+                while (!(w>>j&1))
+                    ++j;
+                visible.push_back(uint32_t(64*i+j));
+            }
+        }
+        for (std::vector<uint64_t>& b: myBits)
+            b.clear();
+    }
+};
+
+//! SpanSink that accumulates VoronoiCellStats for each cell, and passes the span on to another SpanSink.
+template<typename SpanSink>
+class StatsSpanSink {
+    SpanSink myInner;
+    VoronoiCellStats* myStats;
+    //! Pixels outside [0,width)x[0,height) are not counted.
+    int myWidth, myHeight;
+    //! If not null, colors are sampled from *mySource.
+    const NimblePixMap* mySource;
+public:
+    StatsSpanSink(const SpanSink& inner, VoronoiCellStats* stats, int width, int height, const NimblePixMap* source) :
+        myInner(inner), myStats(stats), myWidth(width), myHeight(height), mySource(source) {}
+    void addSpan(int y, int left, int right, size_t cellIndex, OutlinedColor color) {
+        myInner.addSpan(y, left, right, cellIndex, color);
+        if (unsigned(y)<unsigned(myHeight)) {
+            left = Max(left, 0);
+            right = Min(right, myWidth);
+            if (left<right)
+                myStats[cellIndex].addSpan(y, left, right, mySource);
+        }
+    }
+};
+
+//! Arrays of VoronoiCellStats, one per stripe, that are combined into the statistics of a diagram.
+class StatsSet {
+    std::vector<VoronoiCellStats> myStats[N_WORKER_MAX];
+public:
+    //! Clear and return the statistics for stripe k of a diagram with n Ants.
+    VoronoiCellStats* stripe(size_t k, size_t n) {
+        Assert(k<N_WORKER_MAX);
+        myStats[k].resize(n);
+        for (VoronoiCellStats& c: myStats[k])
+            c.clear();
+        return myStats[k].data();
+    }
+    //! Set stats to the merged statistics of the stripes of a diagram with n Ants, and forget the stripes.
+    void collect(size_t n, std::vector<VoronoiCellStats>& stats) {
+        stats.resize(n);
+        for (VoronoiCellStats& c: stats)
+            c.clear();
+        for (std::vector<VoronoiCellStats>& s: myStats) {
+            if (s.size()==n)
+                for (size_t i=0; i<n; ++i)
+                    stats[i].merge(s[i]);
+            s.clear();
+        }
+    }
+};
+
+//! Wrapper that returns the SpanSink for a stripe unchanged.
+struct NoSinkWrapper {
+    template<typename SpanSink>
+    SpanSink operator()(size_t, const SpanSink& sink) const {
+        return sink;
+    }
+};
+
+//! Marks of the Ants to skip, set by PrepareAnts.  The marks of buffer i of a multi-diagram DrawVoronoi start at
+//! the sum of the sizes of the buffers before it.
+std::vector<uint8_t> SkipMarks;
+
+//! Sweep region with the given shape using Ants in [antFirst,antLast), which must be sorted by y.
+/** The Ants must have been passed to PrepareAnts, with no offset.
+    Outline is used only if some Ant has an exterior color.  If window is null, nothing is drawn.
+    Each SpanSink is wrap(k,sink), where sink draws stripe k in the window. */
+template<typename Shape, typename Wrap=NoSinkWrapper>
+void DrawShape(NimblePixMap* window, const Shape& shape, const Ant* antFirst, const Ant* antLast, Wrap wrap=Wrap()) {
+    // Spans of a RectangleShape are inside the window.
+    constexpr bool clip = !std::is_same<Shape, RectangleShape>::value;
+    Assert(SkipMarks.size()>=size_t(antLast-antFirst));
+    VoronoiRasterizer v(RasterizerBuffer(0), antFirst, antLast-antFirst, SkipMarks.data());
+    v.setBoundingBox(shape);
+    const size_t nStripe = StripeCount(v.top(), v.bottom());
+    if (!window) {
+        SweepStripes(v, shape, antFirst, antLast, nStripe, [&](size_t k) {
+            return wrap(k, NullSpanSink());
+        });
+    } else if (std::any_of(antFirst+1, antLast-1, [](const Ant& a) {return a.color.hasExterior(); })) {
+        Outline::start(nStripe, (antLast-antFirst)-2);
+        SweepStripes(v, shape, antFirst, antLast, nStripe, [&](size_t k) {
+            return wrap(k, PixelSpanSink<true, clip>(*window, &Outline::stripe(k)));
+        });
+        Outline::finishAndDraw(*window);
+        CountOutline();
+    } else {
+        SweepStripes(v, shape, antFirst, antLast, nStripe, [&](size_t k) {
+            return wrap(k, PixelSpanSink<false, clip>(*window, nullptr));
+        });
+    }
+}
+
+//! Same as DrawShape, but also write cell ids into idMap.
+template<typename T, typename Shape>
+void DrawShapeWithIds(NimblePixMap* window, const Shape& shape, const Ant* antFirst, const Ant* antLast, const VoronoiIdMap<T>& idMap) {
+    Assert(size_t(antLast-antFirst)-1 <= std::numeric_limits<T>::max());
+    static VisibleSet visibleSet;
+    const size_t n = antLast-antFirst;
+    DrawShape(window, shape, antFirst, antLast, [&](size_t k, const auto& sink) {
+        return IdSpanSink<T, std::decay_t<decltype(sink)>>(sink, idMap, idMap.visible ? visibleSet.stripe(k, n) : nullptr);
+    });
+    if (idMap.visible)
+        visibleSet.collect(*idMap.visible);
+}
+
+//! A VoronoiDiagram, with what DrawVoronoi needs to sweep any stripe of it.
+struct DiagramPart {
+    const CompoundRegion* region;
+    const Ant* antFirst;
+    const Ant* antLast;
+    BoundingBox box;
+    bool oneSegmentPerLine;
+    //! True if some Ant has an exterior color.
+    bool outlined;
+    //! Added to the index of an Ant to get its Outline id, if outlined.
+    size_t idBase;
+    //! Offset of the diagram's marks in SkipMarks.
+    size_t skipBase;
+};
+
+//! Sweep scan lines [yFirst,yLast] of diagram d, which has the given shape, as part of stripe k.
+template<typename Shape>
+void SweepDiagramStripe(NimblePixMap& window, const Shape& shape, const DiagramPart& d, size_t k, int yFirst, int yLast) {
+    VoronoiRasterizer w(RasterizerBuffer(k), d.antFirst, d.antLast-d.antFirst, SkipMarks.data()+d.skipBase);
+    w.setBoundingBox(d.box);
+    if (d.outlined) {
+        PixelSpanSink<true, true> sink(window, &Outline::stripe(k), d.idBase);
+        w.sweep(sink, shape, d.antLast, yFirst, yLast);
+    } else {
+        PixelSpanSink<false, true> sink(window, nullptr);
+        w.sweep(sink, shape, d.antLast, yFirst, yLast);
+    }
+}
+
+//! True if no row of region has more than one segment.
+bool HasOneSegmentPerLine(const CompoundRegion& region) {
+    for (int y=region.top(); y<region.bottom(); ++y)
+        if (region.end(y)-region.begin(y)>1)
+            return false;
+    return true;
+}
+
+//! Invoke f(shape), where shape is the fastest Shape for region.
+template<typename F>
+void WithShapeOf(const CompoundRegion& region, F f) {
+    if (HasOneSegmentPerLine(region))
+        f(CompoundShape<true>(region));
+    else
+        f(CompoundShape<false>(region));
+}
+
+//! Same as DrawShape, but also accumulate cell statistics into stats.
+/** Pixels outside [0,width)x[0,height) are not counted. */
+template<typename Shape>
+void DrawShapeWithStats(NimblePixMap* window, const Shape& shape, const Ant* antFirst, const Ant* antLast,
+                        std::vector<VoronoiCellStats>& stats, int width, int height, const NimblePixMap* source) {
+    static StatsSet statsSet;
+    const size_t n = antLast-antFirst;
+    DrawShape(window, shape, antFirst, antLast, [&](size_t k, const auto& sink) {
+        return StatsSpanSink<std::decay_t<decltype(sink)>>(sink, statsSet.stripe(k, n), width, height, source);
+    });
+    statsSet.collect(n, stats);
+}
+
+//! Set skip[i] to 1 if antFirst[i] is coincident with an earlier Ant that is not skipped, and to 0 otherwise.
+/** Roundoff can make the sweep arbitrate between coincident sites differently depending on the scan line where
+    it started, so sweeps skip the sites marked here.  Then a single sweep and stripes swept independently see the
+    same sites.  The first real Ant is never skipped.
+
+    The Ants must be sorted by y, so coincident Ants are in runs whose successive y differ by at most
+    coincidentSiteDistance.  Within a run, kept Ants are hashed by their cell in a grid of that spacing, and each Ant
+    is compared only with kept Ants in the 3x3 cells around it.  So the pass takes linear time even for long runs
+    of Ants with equal y. */
+void MarkCoincidentSites(const Ant* antFirst, const Ant* antLast, uint8_t* skip) {
+    constexpr float d = coincidentSiteDistance;
+    // Clipping keeps grid coordinates of far away Ants in range.  Those Ants may share cells, which is harmless
+    // because the hash table keeps every kept Ant, and comparisons use exact coordinates.
+    constexpr float gridMax = 1<<30;
+    auto column = [](float x) {return int64_t(std::floor(Clip(-gridMax, gridMax, x/d))); };
+    auto hash = [](int64_t i, int64_t j) {
+        const uint64_t h = uint64_t(i)*0x9E3779B97F4A7C15u ^ uint64_t(j)*0xC2B2AE3D27D4EB4Fu;
+        return size_t(h ^ h>>32);
+    };
+    static std::vector<const Ant*> table;
+    std::fill(skip, skip+(antLast-antFirst), uint8_t(0));
+    for (const Ant* r=antFirst+1; r<antLast-1; ) {
+        // Find run [r,e)
+        const Ant* e = r+1;
+        while (e<antLast-1 && e->y-e[-1].y<=d)
+            ++e;
+        if (e-r>1) {
+            // Open addressing with linear probing, at most half full.
+            const size_t mask = RoundUpToPowerOfTwo(2*size_t(e-r))-1;
+            table.assign(mask+1, nullptr);
+            // True if a kept Ant in cell (i,j) or a cell next to it is coincident with *a.
+            auto isNearKept = [&](const Ant* a, int64_t i, int64_t j) {
+                for (int64_t v=j-1; v<=j+1; ++v)
+                    for (int64_t u=i-1; u<=i+1; ++u)
+                        for (size_t h=hash(u, v)&mask; table[h]; h=h+1&mask)
+                            if (std::fabs(a->x-table[h]->x)<=d && a->y-table[h]->y<=d)
+                                return true;
+                return false;
+            };
+            for (const Ant* a=r; a<e; ++a) {
+                const int64_t i = column(a->x);
+                const int64_t j = column(a->y);
+                if (isNearKept(a, i, j)) {
+                    skip[a-antFirst] = 1;
+                } else {
+                    size_t h = hash(i, j)&mask;
+                    while (table[h])
+                        h = h+1&mask;
+                    table[h] = a;
+                }
+            }
+        }
+        r = e;
+    }
+}
+
+//! Check and prepare Ants in [antFirst,antLast) for sweeping, and set their marks in SkipMarks, starting at skipBase.
+void PrepareAnts(Ant* antFirst, Ant* antLast, size_t skipBase=0) {
+    Assert(antFirst+3<=antLast); // Must have at least two bookends and one ant
+    CountAntsIn((antLast-antFirst)-2);
+    Assert(antFirst[0].y == -AntInfinity);
+    Assert(antLast[-1].y == AntInfinity);
+#if ASSERTIONS
+    for (Ant* a = antFirst+1; a<antLast-1; ++a) {
+        Assert(a->y>-AntInfinity);
+        Assert(a->y<AntInfinity);
+    }
+#endif
+    // Caller may have sorted the Ants already, e.g. with the previous frame's order.
+    if (!std::is_sorted(antFirst+1, antLast-1, Ant::lessY())) {
+        static KeySorter<Ant> sorter;
+        sorter.sort(antFirst+1, antLast-1, [](const Ant& a) {return a.y; });
+    }
+    const size_t n = antLast-antFirst;
+    if (SkipMarks.size()<skipBase+n)
+        SkipMarks.resize(skipBase+n);
+    MarkCoincidentSites(antFirst, antLast, SkipMarks.data()+skipBase);
+}
+
+//! Ants within this many pixels of a shape are always kept, to cover outlines drawn along its edge.
+constexpr float cullMargin = Outline::lineWidth+2;
+
+//! Number of rows and of columns in the grid used by CullHidden.
+constexpr int cullGridSize = 16;
+
+//! Remove Ants in [antFirst,antLast) whose cells cannot reach the shape, and return the new end.
+/** The Ants must be sorted by increasing y.  A grid covers the bounding box of the shape, grown by cullMargin.
+    For each grid cell that the grown shape touches, reach is an upper bound on the distance from any point in the cell
+    to its nearest Ant, found by looking at one representative Ant per grid cell.  An Ant that is farther than reach
+    from every row of touched cells is never nearest to a point of the shape, and neither is any other Ant that is dropped,
+    so dropping them changes no pixel.  Binary search on y confines the work to Ants in rows near the grid. */
+template<typename Shape>
+Ant* CullHidden(Ant* antFirst, Ant* antLast, const Shape& shape) {
+    constexpr int G = cullGridSize;
+    Assert(std::is_sorted(antFirst, antLast, Ant::lessY()));
+    // Not worth the overhead for a few Ants.
+    if (antLast-antFirst<4*G)
+        return antLast;
+    const BoundingBox box = BoundingBoxOf(shape);
+    // DrawVoronoi needs at least one Ant, even for an empty shape.
+    if (box.empty())
+        return antLast;
+    // Row box.maxY is the last row, so the bottom edge of the box is box.maxY+1.
+    const float x0 = box.minX-cullMargin;
+    const float y0 = box.minY-cullMargin;
+    const float w = (box.maxX+cullMargin-x0)/G;
+    const float h = (box.maxY+1+cullMargin-y0)/G;
+    const float x1 = x0+G*w;
+    const float y1 = y0+G*h;
+    auto column = [=](float x) {return Clip(0, G-1, int((x-x0)/w)); };
+    auto row = [=](float y) {return Clip(0, G-1, int((y-y0)/h)); };
+
+    // Find the hull of the grown shape within each row of the grid.
+    float lo[G], hi[G];
+    std::fill_n(lo, G, FLT_MAX);
+    std::fill_n(hi, G, -FLT_MAX);
+    for (int y=shape.top(); y<shape.bottom(); ++y)
+        if (!shape.empty(y)) {
+            const float l = shape.left(y)-cullMargin;
+            const float r = shape.right(y)+cullMargin;
+            for (int j=row(y-cullMargin), jLast=row(y+1+cullMargin); j<=jLast; ++j) {
+                lo[j] = Min(lo[j], l);
+                hi[j] = Max(hi[j], r);
+            }
+        }
+
+    // Pick the Ant nearest the center of each grid cell as its representative.
+    auto firstAtOrBelow = [=](float y) {
+        return std::lower_bound(antFirst, antLast, y, [](const Ant& a, float y) {return a.y<y; });
+    };
+    auto firstBelow = [=](float y) {
+        return std::upper_bound(antFirst, antLast, y, [](float y, const Ant& a) {return y<a.y; });
+    };
+    const Ant* rep[G][G] = {};
+    float repDist2[G][G];
+    for (const Ant* a=firstAtOrBelow(y0), *aLast=firstAtOrBelow(y1); a<aLast; ++a)
+        if (x0<=a->x && a->x<x1) {
+            const int i = column(a->x);
+            const int j = row(a->y);
+            const float d2 = Dist2(*a, Point(x0+(i+0.5f)*w, y0+(j+0.5f)*h));
+            if (!rep[j][i] || d2<repDist2[j][i]) {
+                rep[j][i] = a;
+                repDist2[j][i] = d2;
+            }
+        }
+
+    // Compute the reach of each touched grid cell, searching rings of cells around it.
+    // Touched cells in a row of the grid form a band, whose reach is the greatest reach of its cells.
+    struct bandType {
+        float left, top, right, bottom;
+        float reach2;
+    };
+    bandType band[G];
+    size_t nBand = 0;
+    float reach2Max = 0;
+    for (int j=0; j<G; ++j) {
+        if (!(lo[j]<hi[j]))
+            continue;
+        bandType& b = band[nBand++];
+        const int iFirst = column(lo[j]);
+        const int iLast = column(hi[j]);
+        b.left = x0+iFirst*w;
+        b.right = x0+(iLast+1)*w;
+        b.top = y0+j*h;
+        b.bottom = b.top+h;
+        b.reach2 = 0;
+        for (int i=iFirst; i<=iLast; ++i) {
+            const float left = x0+i*w;
+            const float right = left+w;
+            float best = FLT_MAX;
+            auto visit = [&](int u, int v) {
+                if (const Ant* a = rep[v][u]) {
+                    // Distance from a to the farthest corner of the cell.
+                    const float dx = Max(std::fabs(a->x-left), std::fabs(a->x-right));
+                    const float dy = Max(std::fabs(a->y-b.top), std::fabs(a->y-b.bottom));
+                    best = Min(best, dx*dx+dy*dy);
                 }
-                if (v.frontierIsEmpty())
+            };
+            for (int r=0; r<G; ++r) {
+                // Ants in ring r of cells around the cell are at least r-1 cells away from it.
+                const float gap = (r-1)*Min(w, h);
+                if (r>1 && gap*gap>=best)
                     break;
+                for (int v=Max(0, j-r); v<=Min(G-1, j+r); ++v)
+                    if (v==j-r || v==j+r) {
+                        for (int u=Max(0, i-r); u<=Min(G-1, i+r); ++u)
+                            visit(u, v);
+                    } else {
+                        if (i-r>=0)
+                            visit(i-r, v);
+                        if (i+r<G)
+                            visit(i+r, v);
+                    }
             }
-            v.drawLive(window, region);
+            if (best==FLT_MAX)
+                // No Ant is inside the grid, so there is nothing to compare with.
+                return antLast;
+            // Allow a pixel for roundoff.
+            const float reach = std::sqrt(best)+1;
+            b.reach2 = Max(b.reach2, reach*reach);
+        }
+        reach2Max = Max(reach2Max, b.reach2);
+    }
+
+    // Keep Ants in the grid, and Ants within reach of a band.
+    auto distance2 = [](const Ant& a, float left, float top, float right, float bottom) {
+        const float dx = Max(0.0f, Max(left-a.x, a.x-right));
+        const float dy = Max(0.0f, Max(top-a.y, a.y-bottom));
+        return dx*dx+dy*dy;
+    };
+    // Ants above or below the grid by more than the greatest reach are dropped without looking at them.
+    // The extra pixel covers roundoff in the square root.
+    const float reachMax = std::sqrt(reach2Max)+1;
+    Ant* out = antFirst;
+    for (Ant* a=firstAtOrBelow(y0-reachMax), *aLast=firstBelow(y1+reachMax); a<aLast; ++a) {
+        bool keep = x0<=a->x && a->x<x1 && y0<=a->y && a->y<y1;
+        if (!keep && distance2(*a, x0, y0, x1, y1)<=reach2Max)
+            for (size_t k=0; k<nBand && !keep; ++k) {
+                const bandType& b = band[k];
+                keep = distance2(*a, b.left, b.top, b.right, b.bottom)<=b.reach2;
+            }
+        if (keep)
+            *out++ = *a;
+    }
+    return out;
+}
+
+} // (anonymous)
+
+//! Draw Voronoi diagram on the given window within the given region, using Ants in [antFirst,antLast).
+void DrawVoronoi(NimblePixMap& window, const CompoundRegion& region, Ant* antFirst, Ant* antLast) {
+    Assert(region.bottom() <= window.height()+region.lineWidth);
+    Assert(region.assertOkay());
+    PrepareAnts(antFirst, antLast);
+    if (HasOneSegmentPerLine(region))
+        DrawShape(&window, CompoundShape<true>(region), antFirst, antLast);
+    else
+        DrawShape(&window, CompoundShape<false>(region), antFirst, antLast);
+    FinishStats();
+}
+
+//! Draw Voronoi diagram on the given window within the given rectangle, using Ants in [antFirst,antLast).
+void DrawVoronoi(NimblePixMap& window, const NimbleRect& rect, Ant* antFirst, Ant* antLast) {
+    Assert(0<=rect.left && rect.right<=window.width());
+    Assert(0<=rect.top && rect.bottom<=window.height());
+    Assert(rect.bottom-rect.top <= MAX_STRIPE_HEIGHT);
+    PrepareAnts(antFirst, antLast);
+    if (rect.left<rect.right && rect.top<rect.bottom)
+        DrawShape(&window, RectangleShape(rect), antFirst, antLast);
+    FinishStats();
+}
+
+//! Draw Voronoi diagram within the given region, if window is not null, and write cell ids into idMap.
+template<typename T>
+void DrawVoronoi(NimblePixMap* window, const CompoundRegion& region, Ant* antFirst, Ant* antLast, const VoronoiIdMap<T>& idMap) {
+    Assert(!window || region.bottom() <= window->height()+region.lineWidth);
+    Assert(region.assertOkay());
+    PrepareAnts(antFirst, antLast);
+    WithShapeOf(region, [&](const auto& shape) {
+        DrawShapeWithIds(window, shape, antFirst, antLast, idMap);
+    });
+    FinishStats();
+}
+
+//! Draw Voronoi diagram within the given rectangle, if window is not null, and write cell ids into idMap.
+template<typename T>
+void DrawVoronoi(NimblePixMap* window, const NimbleRect& rect, Ant* antFirst, Ant* antLast, const VoronoiIdMap<T>& idMap) {
+    Assert(0<=rect.left && rect.right<=(window ? window->width() : idMap.width));
+    Assert(0<=rect.top && rect.bottom<=(window ? window->height() : idMap.height));
+    Assert(rect.bottom-rect.top <= MAX_STRIPE_HEIGHT);
+    PrepareAnts(antFirst, antLast);
+    if (rect.left<rect.right && rect.top<rect.bottom)
+        DrawShapeWithIds(window, RectangleShape(rect), antFirst, antLast, idMap);
+    else if (idMap.visible)
+        idMap.visible->clear();
+    FinishStats();
+}
+
+template void DrawVoronoi(NimblePixMap*, const CompoundRegion&, Ant*, Ant*, const VoronoiIdMap<uint16_t>&);
+template void DrawVoronoi(NimblePixMap*, const CompoundRegion&, Ant*, Ant*, const VoronoiIdMap<uint32_t>&);
+template void DrawVoronoi(NimblePixMap*, const NimbleRect&, Ant*, Ant*, const VoronoiIdMap<uint16_t>&);
+template void DrawVoronoi(NimblePixMap*, const NimbleRect&, Ant*, Ant*, const VoronoiIdMap<uint32_t>&);
+
+void VoronoiCellStats::clear() {
+    area = 0;
+    sumX = 0;
+    sumY = 0;
+    box.left = box.top = std::numeric_limits<int16_t>::max();
+    box.right = box.bottom = std::numeric_limits<int16_t>::min();
+    sumRed = sumGreen = sumBlue = 0;
+}
+
+void VoronoiCellStats::addSpan(int y, int left, int right, const NimblePixMap* source) {
+    Assert(left<right);
+    const int n = right-left;
+    area += n;
+    // Pixel centers are offset by 0.5.
+    sumX += 0.5*n*(left+right);
+    sumY += n*(y+0.5);
+    box.left = Min<int>(box.left, left);
+    box.right = Max<int>(box.right, right);
+    box.top = Min<int>(box.top, y);
+    box.bottom = Max<int>(box.bottom, y+1);
+    if (source) {
+        Assert(right<=source->width() && y<source->height());
+        const NimblePixel* p = (const NimblePixel*)source->at(left, y);
+        for (int i=0; i<n; ++i) {
+            sumRed += p[i]>>16 & 0xFF;
+            sumGreen += p[i]>>8 & 0xFF;
+            sumBlue += p[i] & 0xFF;
         }
-        v.advanceLive();
     }
-    Outline::finishAndDraw(window);
-#if STATISTICS
-    Stats& s = TheStats;
-#endif /* STATISTICS */
 }
 
+void VoronoiCellStats::merge(const VoronoiCellStats& other) {
+    area += other.area;
+    sumX += other.sumX;
+    sumY += other.sumY;
+    box.left = Min(box.left, other.box.left);
+    box.right = Max(box.right, other.box.right);
+    box.top = Min(box.top, other.box.top);
+    box.bottom = Max(box.bottom, other.box.bottom);
+    sumRed += other.sumRed;
+    sumGreen += other.sumGreen;
+    sumBlue += other.sumBlue;
+}
+
+NimblePixel VoronoiCellStats::averageColor() const {
+    Assert(area>0);
+    auto average = [&](uint64_t sum) {return NimblePixel((sum+area/2)/area); };
+    return 0xFF000000 | average(sumRed)<<16 | average(sumGreen)<<8 | average(sumBlue);
+}
+
+//! Draw Voronoi diagram within the given region, if window is not null, and accumulate cell statistics into stats.
+void DrawVoronoi(NimblePixMap* window, const CompoundRegion& region, Ant* antFirst, Ant* antLast, std::vector<VoronoiCellStats>& stats, const NimblePixMap* source) {
+    Assert(window || source);
+    const NimblePixMap& bounds = source ? *source : *window;
+    Assert(!window || region.bottom() <= window->height()+region.lineWidth);
+    Assert(!window || !source || (source->width()>=window->width() && source->height()>=window->height()));
+    Assert(region.assertOkay());
+    PrepareAnts(antFirst, antLast);
+    WithShapeOf(region, [&](const auto& shape) {
+        DrawShapeWithStats(window, shape, antFirst, antLast, stats, bounds.width(), bounds.height(), source);
+    });
+    FinishStats();
+}
+
+//! Draw Voronoi diagram within the given rectangle, if window is not null, and accumulate cell statistics into stats.
+void DrawVoronoi(NimblePixMap* window, const NimbleRect& rect, Ant* antFirst, Ant* antLast, std::vector<VoronoiCellStats>& stats, const NimblePixMap* source) {
+    Assert(window || source);
+    const NimblePixMap& bounds = source ? *source : *window;
+    Assert(0<=rect.left && rect.right<=bounds.width() && (!window || rect.right<=window->width()));
+    Assert(0<=rect.top && rect.bottom<=bounds.height() && (!window || rect.bottom<=window->height()));
+    Assert(rect.bottom-rect.top <= MAX_STRIPE_HEIGHT);
+    PrepareAnts(antFirst, antLast);
+    if (rect.left<rect.right && rect.top<rect.bottom) {
+        DrawShapeWithStats(window, RectangleShape(rect), antFirst, antLast, stats, bounds.width(), bounds.height(), source);
+    } else {
+        stats.resize(antLast-antFirst);
+        for (VoronoiCellStats& c: stats)
+            c.clear();
+    }
+    FinishStats();
+}
+
+void DrawVoronoi(NimblePixMap& window, const VoronoiDiagram* first, const VoronoiDiagram* last) {
+    static std::vector<DiagramPart> parts;
+    parts.clear();
+    // Ids of outlined diagrams are assigned consecutively, in the order of the diagrams.
+    size_t idCount = 0;
+    size_t skipCount = 0;
+    float top = FLT_MAX;
+    float bottom = -FLT_MAX;
+    for (const VoronoiDiagram* d=first; d!=last; ++d) {
+        Assert(d->region->bottom() <= window.height()+d->region->lineWidth);
+        Assert(d->region->assertOkay());
+        PrepareAnts(d->antFirst, d->antLast, skipCount);
+        DiagramPart p;
+        p.skipBase = skipCount;
+        skipCount += d->antLast-d->antFirst;
+        p.box = BoundingBoxOf(CompoundShape<false>(*d->region));
+        if (p.box.empty())
+            continue;
+        p.region = d->region;
+        p.antFirst = d->antFirst;
+        p.antLast = d->antLast;
+        p.oneSegmentPerLine = HasOneSegmentPerLine(*d->region);
+        p.outlined = std::any_of(d->antFirst+1, d->antLast-1, [](const Ant& a) {return a.color.hasExterior(); });
+        p.idBase = idCount;
+        if (p.outlined)
+            idCount += (d->antLast-d->antFirst)-2;
+        top = Min(top, p.box.minY);
+        bottom = Max(bottom, p.box.maxY);
+        parts.push_back(p);
+    }
+    if (parts.empty()) {
+        FinishStats();
+        return;
+    }
+
+    // All diagrams share one set of stripes.  Within a stripe, the diagrams are swept one after another,
+    // each with its own live list, since a cell depends only on the Ants of its diagram.
+    const size_t nStripe = StripeCount(top, bottom);
+    const int height = int(bottom)-int(top)+1;
+    auto yFirst = [=](size_t k) {return int(top) + int(height*k/nStripe); };
+    auto sweepStripe = [&](size_t k) {
+        for (const DiagramPart& d: parts) {
+            const int y0 = Max(yFirst(k), int(d.box.minY));
+            const int y1 = Min(yFirst(k+1)-1, int(d.box.maxY));
+            if (y0<=y1) {
+                if (d.oneSegmentPerLine)
+                    SweepDiagramStripe(window, CompoundShape<true>(*d.region), d, k, y0, y1);
+                else
+                    SweepDiagramStripe(window, CompoundShape<false>(*d.region), d, k, y0, y1);
+            }
+        }
+    };
+    if (idCount>0)
+        Outline::start(nStripe, idCount);
+    if (nStripe==1) {
+        sweepStripe(0);
+    } else {
+        for (size_t k=0; k<nStripe; ++k)
+            RasterizerBuffer(k);
+        ParallelFor(nStripe, sweepStripe);
+    }
+    if (idCount>0) {
+        Outline::finishAndDraw(window);
+        CountOutline();
+    }
+    FinishStats();
+}
+
+Ant* CullHiddenAnts(Ant* antFirst, Ant* antLast, const CompoundRegion& region) {
+    Assert(region.assertOkay());
+    if (HasOneSegmentPerLine(region))
+        return CullHidden(antFirst, antLast, CompoundShape<true>(region));
+    else
+        return CullHidden(antFirst, antLast, CompoundShape<false>(region));
+}
+
+Ant* CullHiddenAnts(Ant* antFirst, Ant* antLast, const NimbleRect& rect) {
+    if (!(rect.left<rect.right && rect.top<rect.bottom))
+        return antLast;
+    return CullHidden(antFirst, antLast, RectangleShape(rect));
+}
+
+//! True if MergeSubpixelAnts should keep a instead of b for the square with the given center.
+static bool IsBetterMergeRepresentative(const Ant& a, const Ant& b, Point center) {
+    if (a.color.hasExterior()!=b.color.hasExterior())
+        return a.color.hasExterior();
+    const float da = Dist2(a, center);
+    const float db = Dist2(b, center);
+    if (da!=db)
+        return da<db;
+    if (a.y!=b.y)
+        return a.y<b.y;
+    if (a.x!=b.x)
+        return a.x<b.x;
+    if (a.color.interior()!=b.color.interior())
+        return a.color.interior()<b.color.interior();
+    return a.color.hasExterior() && a.color.exterior()<b.color.exterior();
+}
+
+Ant* MergeSubpixelAnts(Ant* antFirst, Ant* antLast, float cellSize) {
+    Assert(cellSize>0);
+    const size_t n = antLast-antFirst;
+    if (n<2)
+        return antLast;
+    // Open-addressing hash table from grid cell to the index of its representative, with at least twice as many slots as Ants.
+    struct slotType {
+        uint64_t key;
+        uint32_t index;
+    };
+    constexpr uint32_t empty = ~uint32_t(0);
+    static std::vector<slotType> table;
+    int shift = 64;
+    while ((size_t(1)<<(64-shift))<2*n)
+        --shift;
+    const size_t mask = (size_t(1)<<(64-shift))-1;
+    table.assign(mask+1, slotType{0, empty});
+
+    auto cellOf = [cellSize](float z) {
+        // Clip so that far away Ants still get a valid cell.
+        return uint32_t(int32_t(Clip(-2E9f, 2E9f, std::floor(z/cellSize))));
+    };
+    Ant* out = antFirst;
+    for (const Ant* a=antFirst; a<antLast; ++a) {
+        const uint64_t key = uint64_t(cellOf(a->y))<<32 | cellOf(a->x);
+        size_t h = size_t(key*0x9E3779B97F4A7C15u>>shift);
+        while (table[h].index!=empty && table[h].key!=key)
+            h = (h+1)&mask;
+        slotType& s = table[h];
+        if (s.index==empty) {
+            s.key = key;
+            s.index = uint32_t(out-antFirst);
+            *out++ = *a;
+        } else {
+            // A better Ant replaces the representative, but keeps the place of the first Ant in the cell.
+            Ant& r = antFirst[s.index];
+            const Point center((float(int32_t(uint32_t(key)))+0.5f)*cellSize, (float(int32_t(key>>32))+0.5f)*cellSize);
+            if (IsBetterMergeRepresentative(*a, r, center))
+                r = *a;
+        }
+    }
+    return out;
+}
+
+void DrawVoronoiStream(int width, int height, const std::function<size_t(Ant*, size_t)>& readAnts, const std::function<void(int, const NimblePixel*)>& putRow) {
+    Assert(0<width && width<=RegionSegment::valueTypeMax);
+    Assert(0<height);
+    // Initial capacity of the stream's buffer.  It grows if the rasterizer refers to more Ants.
+    constexpr size_t streamCapacity = 1<<14;
+    const std::function<size_t(Ant*, size_t)> countingReadAnts = [&](Ant* a, size_t n) {
+        const size_t m = readAnts(a, n);
+        CountAntsIn(m);
+        return m;
+    };
+    AntStream stream(countingReadAnts, streamCapacity);
+    RowSpanSink sink(width, putRow);
+    const RectangleShape shape(0, 0, width, height);
+    VoronoiRasterizer v(RasterizerBuffer(0), stream.first(), streamCapacity);
+    v.setBoundingBox(shape);
+    v.sweepStream(sink, shape, stream);
+    FinishStats();
+}
+
+const VoronoiStats& LastVoronoiStats() {
+    return LastStats;
+}
+
+VoronoiStats TakeVoronoiFrameStats() {
+    VoronoiStats s = FrameStats;
+    FrameStats.clear();
+    return s;
+}
+
+void VoronoiStats::clear() {
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1))
+        count[i] = 0;
+}
+
+void VoronoiStats::operator+=(const VoronoiStats& other) {
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1))
+        if (i==VoronoiStat::liveMax)
+            count[i] = Max(count[i], other.count[i]);
+        else
+            count[i] += other.count[i];
+}
+
+const char* VoronoiStats::name(VoronoiStat i) {
+    switch (i) {
+        case VoronoiStat::antsIn: return "antsIn";
+        case VoronoiStat::antsInserted: return "antsInserted";
+        case VoronoiStat::linesSwept: return "linesSwept";
+        case VoronoiStat::linesEmpty: return "linesEmpty";
+        case VoronoiStat::merges: return "merges";
+        case VoronoiStat::pushes: return "pushes";
+        case VoronoiStat::pops: return "pops";
+        case VoronoiStat::liveMax: return "liveMax";
+        case VoronoiStat::spans: return "spans";
+        case VoronoiStat::outlineSegments: return "outlineSegments";
+        case VoronoiStat::outlineIds: return "outlineIds";
+        case VoronoiStat::outlineGrowths: return "outlineGrowths";
+    }
+    Assert(false);
+    return "";
+}
+
+void VoronoiStats::writeCsvHeader(FILE* f) {
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1))
+        fprintf(f, i==VoronoiStat(0) ? "%s" : ",%s", name(i));
+    fprintf(f, "\n");
+}
+
+void VoronoiStats::writeCsv(FILE* f) const {
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1))
+        fprintf(f, i==VoronoiStat(0) ? "%llu" : ",%llu", (unsigned long long)count[i]);
+    fprintf(f, "\n");
+}
+
+void VoronoiStatsHistogram::clear() {
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1))
+        for (uint64_t& c: myCount[i].bucket)
+            c = 0;
+}
+
+void VoronoiStatsHistogram::add(const VoronoiStats& s) {
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1)) {
+        // Bucket is the bit length of the count.
+        size_t b = 0;
+        for (uint64_t v=s.count[i]; v; v>>=1)
+            ++b;
+        ++myCount[i][b];
+    }
+}
+
+void VoronoiStatsHistogram::writeCsv(FILE* f) const {
+    fprintf(f, "stat");
+    for (size_t b=0; b<nBucket; ++b)
+        fprintf(f, b==0 ? ",0" : ",%llu", 1ull<<(b-1));
+    fprintf(f, "\n");
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1)) {
+        fprintf(f, "%s", VoronoiStats::name(i));
+        for (size_t b=0; b<nBucket; ++b)
+            fprintf(f, ",%llu", (unsigned long long)myCount[i].bucket[b]);
+        fprintf(f, "\n");
+    }
+}
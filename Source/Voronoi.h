@@ -17,12 +17,188 @@
 #define VORONOI_H
 
 #include "Ant.h"
+#include "Enum.h"
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
 
 class CompoundRegion;
 
+//! Kinds of work that the rasterizer counts.
+enum class VoronoiStat : int8_t {
+    antsIn,             //!< Ants passed in, not counting bookends
+    antsInserted,       //!< Insertions of sites into a live list
+    linesSwept,         //!< Scan lines drawn
+    linesEmpty,         //!< Scan lines skipped because the region is empty on them
+    merges,             //!< Merges of a non-empty frontier into a live list
+    pushes,             //!< Sites put in a bucket to be reconsidered on a later scan line
+    pops,               //!< Sites popped from buckets to the frontier
+    liveMax,            //!< Maximum number of sites in a live list
+    spans,              //!< Spans emitted, including empty ones
+    outlineSegments,    //!< Segments recorded for outlines
+    outlineIds,         //!< Cell ids that Outline made room for
+    outlineGrowths      //!< Enlargements of Outline's storage
+};
+
+template<>
+constexpr VoronoiStat EnumMax<VoronoiStat> = VoronoiStat::outlineGrowths;
+
+//! Counts of work done by the rasterizer.
+struct VoronoiStats {
+    EnumMap<VoronoiStat, uint64_t> count;
+
+    VoronoiStats() { clear(); }
+    void clear();
+    //! Add counts of other, except for liveMax, which becomes the maximum of the two.
+    void operator+=(const VoronoiStats& other);
+    //! Name of a kind of count, as used in column headings.
+    static const char* name(VoronoiStat s);
+    //! Write names of the counts as one line of comma-separated values.
+    static void writeCsvHeader(FILE* f);
+    //! Write counts as one line of comma-separated values, in the order of writeCsvHeader.
+    void writeCsv(FILE* f) const;
+};
+
+//! Histograms of VoronoiStats, for example one sample per frame.
+class VoronoiStatsHistogram {
+public:
+    //! Bucket b>0 holds samples with a count in [2^(b-1),2^b).  Bucket 0 holds samples with a count of zero.
+    static const size_t nBucket = 65;
+    VoronoiStatsHistogram() { clear(); }
+    void clear();
+    void add(const VoronoiStats& sample);
+    //! Number of samples in bucket b of the histogram for s.
+    uint64_t operator()(VoronoiStat s, size_t b) const { return myCount[s][b]; }
+    //! Write one line of comma-separated values per kind of count: its name, then the number of samples in each bucket.
+    void writeCsv(FILE* f) const;
+private:
+    struct histogramType {
+        uint64_t bucket[nBucket];
+        uint64_t& operator[](size_t b) { return bucket[b]; }
+        const uint64_t& operator[](size_t b) const { return bucket[b]; }
+    };
+    EnumMap<VoronoiStat, histogramType> myCount;
+};
+
+//! Counts of work done by the most recent DrawVoronoi or DrawVoronoiStream call.
+const VoronoiStats& LastVoronoiStats();
+
+//! Return sum of VoronoiStats of the calls since the previous call of TakeVoronoiFrameStats, and start a new sum.
+//!
+//! Intended to be called once per frame.
+VoronoiStats TakeVoronoiFrameStats();
+
 //! Draw Voronoi diagram.
 //!
-//! Sorts sequence [antFirst,antLast).
+//! Sorts sequence [antFirst,antLast) by y, which is fastest if it is already sorted.
+//! Tall regions are split into horizontal stripes that are swept by up to WorkerCount() threads.
+//! The result does not depend on the number of stripes.
 void DrawVoronoi(NimblePixMap& window, const CompoundRegion& region, Ant* antFirst, Ant* antLast);
 
+//! Draw Voronoi diagram within a rectangle that lies inside the window.
+//!
+//! Same as drawing within a CompoundRegion built for the rectangle, but faster.
+void DrawVoronoi(NimblePixMap& window, const NimbleRect& rect, Ant* antFirst, Ant* antLast);
+
+//! Remove Ants in [antFirst,antLast) whose cells cannot reach the region, and return the new end of the sequence.
+//!
+//! The sequence must be sorted by increasing y and must not include bookends.
+//! Kept Ants stay in the same relative order.  At least one Ant is kept.
+//! An Ant is dropped only if other Ants provably own every pixel of the region and of a margin around it,
+//! so drawing the kept Ants yields the same pixels, including outlines.
+Ant* CullHiddenAnts(Ant* antFirst, Ant* antLast, const CompoundRegion& region);
+
+//! Same as the CompoundRegion version, but for a rectangle.
+Ant* CullHiddenAnts(Ant* antFirst, Ant* antLast, const NimbleRect& rect);
+
+//! Collapse Ants in [antFirst,antLast) that fall in the same cellSize x cellSize square into one Ant, and return the new end of the sequence.
+//!
+//! The sequence must not include bookends.  The Ant kept for a square is an outlined one if there are any, and among
+//! those the one nearest the square's center.  Remaining ties go to the Ant with least y, then x, then color.
+//! So which Ant is kept does not depend on the order of the sequence, and an outlined cell's site moves only when
+//! its Ants move.  Each kept Ant takes the place of the first Ant in its square.
+Ant* MergeSubpixelAnts(Ant* antFirst, Ant* antLast, float cellSize);
+
+//! Voronoi diagram of Ants in [antFirst,antLast) within a region, as one of several drawn together.
+struct VoronoiDiagram {
+    const CompoundRegion* region;
+    Ant* antFirst;
+    Ant* antLast;
+};
+
+//! Draw Voronoi diagrams [first,last), whose regions must not overlap.
+//!
+//! Same as calling DrawVoronoi for each diagram, but with one parallel dispatch and one Outline pass for all of them.
+//! The diagrams share one set of stripes, and each stripe sweeps the diagrams that cross it one after another.
+//! Each diagram still gets its own y-sort, bounding box, and sweep, because its cells depend only on its own Ants.
+void DrawVoronoi(NimblePixMap& window, const VoronoiDiagram* first, const VoronoiDiagram* last);
+
+//! Buffer that receives, for each pixel, the index of the Ant whose cell covers it.
+template<typename T>
+struct VoronoiIdMap {
+    //! Id of pixel (x,y) is ids[y*pitch+x].
+    T* ids;
+    size_t pitch;
+    //! Pixels outside [0,width)x[0,height) are not written.
+    int width, height;
+    //! If not null, set to the indices of Ants that cover at least one written pixel, in increasing order.
+    std::vector<uint32_t>* visible;
+};
+
+//! Draw Voronoi diagram and write the index of each pixel's Ant into idMap.
+//!
+//! Indices are positions in [antFirst,antLast) after the Ants are sorted by y.
+//! Ids are written only for pixels inside the region and are not affected by outlines.
+//! If window is null, only the ids are written.  T must be uint16_t or uint32_t.
+template<typename T>
+void DrawVoronoi(NimblePixMap* window, const CompoundRegion& region, Ant* antFirst, Ant* antLast, const VoronoiIdMap<T>& idMap);
+
+//! Same as the CompoundRegion version, but for a rectangle that lies inside the window, or inside idMap if window is null.
+template<typename T>
+void DrawVoronoi(NimblePixMap* window, const NimbleRect& rect, Ant* antFirst, Ant* antLast, const VoronoiIdMap<T>& idMap);
+
+//! Statistics of the pixels covered by a Voronoi cell.
+struct VoronoiCellStats {
+    //! Number of pixels
+    uint32_t area;
+    //! Sums of the coordinates of pixel centers, which are offset by 0.5 from pixel corners.
+    double sumX, sumY;
+    //! Bounding box of the pixels.  Undefined if area==0.
+    NimbleRect box;
+    //! Sums of the color components of the source pixels.  Zero if there is no source.
+    uint64_t sumRed, sumGreen, sumBlue;
+
+    //! Set to statistics of no pixels.
+    void clear();
+    //! Add pixels [left,right) of row y, sampling colors from source if it is not null.
+    void addSpan(int y, int left, int right, const NimblePixMap* source);
+    //! Add statistics of other pixels.
+    void merge(const VoronoiCellStats& other);
+    //! Centroid of the pixels.  Requires area>0.
+    Point centroid() const { return Point(float(sumX/area), float(sumY/area)); }
+    //! Average source color of the pixels.  Requires area>0.
+    NimblePixel averageColor() const;
+};
+
+//! Draw Voronoi diagram and compute statistics of each cell in the same pass.
+//!
+//! stats is resized to antLast-antFirst, and stats[i] describes the cell of the Ant at position i after the Ants are sorted by y.
+//! Only pixels inside the region and inside the source, or inside the window if source is null, are counted.
+//! Colors are sampled from source if it is not null.  If window is null, nothing is drawn, and source must not be null.
+void DrawVoronoi(NimblePixMap* window, const CompoundRegion& region, Ant* antFirst, Ant* antLast, std::vector<VoronoiCellStats>& stats, const NimblePixMap* source);
+
+//! Same as the CompoundRegion version, but for a rectangle that lies inside the window and source.
+void DrawVoronoi(NimblePixMap* window, const NimbleRect& rect, Ant* antFirst, Ant* antLast, std::vector<VoronoiCellStats>& stats, const NimblePixMap* source);
+
+//! Draw Voronoi diagram of a stream of sites, one row of pixels at a time.
+//!
+//! readAnts(buffer,n) must copy up to n Ants to buffer and return how many it copied.  Zero means the stream ended.
+//! The stream must be sorted by y.  putRow(y,row) is called for y=0..height-1 in order, with width pixels for row y.
+//! Only interior colors are drawn.  The width must fit in a RegionSegment.
+//! Memory is proportional to the number of cells that cross a row and to the number of sites near the current row,
+//! not to the length of the stream.  Sites above the image are pulled when the first row is drawn.
+void DrawVoronoiStream(int width, int height, const std::function<size_t(Ant*, size_t)>& readAnts,
+                       const std::function<void(int, const NimblePixel*)>& putRow);
+
 #endif /* VORONOI_H */
\ No newline at end of file
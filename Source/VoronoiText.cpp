@@ -190,19 +190,15 @@ Ant* VoronoiText::copyToAnts(Ant* a, Point upperLeft, float scale) {
 }
 
 void VoronoiText::drawOn(NimblePixMap& window, const CompoundRegion& region, Point upperLeft, float scale) {
-    Ant* a = Ant::openBuffer();
+    Ant* a = Ant::openBuffer(antCountMax());
     a = copyToAnts(a, upperLeft, scale);
     Ant::closeBufferAndDraw(window, region, a, false);
 }
 
 void VoronoiText::drawOn(NimblePixMap& window, int x, int y, float scale, bool compose) {
-    CompoundRegion region;
-    region.buildRectangle(Point(0, 0), Point(window.width(), window.height()));
-    Assert(region.assertOkay());
-    Ant* a = Ant::openBuffer();
+    Ant* a = Ant::openBuffer(antCountMax());
     a = copyToAnts(a, Point(x, y), scale);
-    Assert(region.assertOkay());
-    Ant::closeBufferAndDraw(window, region, a, compose);
+    Ant::closeBufferAndDraw(window, NimbleRect(0, 0, window.width(), window.height()), a, compose);
 }
 
 void VoronoiCounter::initialize(NimblePixMap& window, int width, int height, int initialValue, int upperLimit, int extra, NimbleColor c0, NimbleColor c1) {
@@ -290,7 +286,7 @@ void VoronoiMeter::drawOn(NimblePixMap& window, int x, int y) {
         myTextIsOutOfDate = false;
     }
 
-    Ant* a = Ant::openBuffer();
+    Ant* a = Ant::openBuffer(myText.antCountMax()+myLives.antCount()+myMissiles.antCount());
     a = myText.copyToAnts(a, Point(x, y+height()/2));
     a = myLives.copyToAnts(window, region, a, x, y);
     a = myMissiles.copyToAnts(window, region, a, x+width()/2, y+height()/2);
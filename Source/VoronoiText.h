@@ -118,6 +118,8 @@ public:
     //! Generate ants for *this.
     /** Useful when diplaying text as part of a larger Voronoi diagram */
     Ant* copyToAnts(Ant* a, Point upperLeft, float scale=1);
+    //! Upper bound on number of Ants that copyToAnts generates.
+    size_t antCountMax() const { return size_t(myWidth)*myHeight*VoronoiChar::maxSize; }
     void drawOn(NimblePixMap& window, const CompoundRegion& region, Point upperLeft, float scale=1);
     void drawOn(NimblePixMap& window, int x, int y, float scale=1, bool compose=false);
     //! Initialize to hold given number of rows and columns of characters.
@@ -165,6 +167,8 @@ class VoronoiCounter {
 public:
     void initialize(NimblePixMap& window, int width, int height, int initialValue, int upperLimit, int extra, NimbleColor c0, NimbleColor c1);
     Ant* copyToAnts(NimblePixMap& window, CompoundRegion region, Ant* a, int x, int y);
+    //! Number of Ants that copyToAnts generates.
+    size_t antCount() const { return myBug.size(); }
     int operator+=(int addend);
     int value() const { return myValue; }
     int upperLimit() const { return myUpperLimit; }
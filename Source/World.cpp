@@ -18,6 +18,7 @@
 #include "Config.h"
 #include "Dot.h"
 #include "Finale.h"
+#include "Host.h"
 #include "Neighborhood.h"
 #include "Outline.h"
 #include "Pond.h"
@@ -31,6 +32,7 @@
 #include "VoronoiText.h"
 #include "Splash.h"
 #include <climits>
+#include <vector>
 
 namespace {
 
@@ -236,15 +238,26 @@ namespace {
 
 void DrawBackground(NimblePixMap& window, CompoundRegion& region) {
     if (!region.empty()) {
-        Ant* a = Ant::openBuffer();
+        Ant* a = Ant::openBuffer(Land.size());
         a = Land.copyToAnts(a, World::viewTransform);
-        Ant::closeBufferAndDraw(window, region, a, false);
+        Ant::closeBuffer(window, region, a, false);
     }
 }
 
-//! Draw Ponds with indices [first,last) in given region
+//! DrawPondGroup merges Ants when beetles are packed closer than this many pixels.
+constexpr float mergeSpacing = 4;
+
+//! Size in pixels of the squares within which DrawPondGroup merges Ants.
+constexpr float mergeCellSize = 2;
+
+//! Fill buffer for Ponds with indices [first,last), to be drawn in given region by Ant::drawClosedBuffers
 void DrawPondGroup(NimblePixMap& window, CompoundRegion& region, size_t first, size_t last) {
-    Ant* a = Ant::openBuffer();
+    // One Ant for self, plus text, missiles, and beetles in the ponds
+    size_t n = 1+Finale::antCountMax()+Missiles::antCountMax();
+    for (size_t k=first; k<last; ++k)
+        n += PondSet[k].size();
+    Ant* const antFirst = Ant::openBuffer(n);
+    Ant* a = antFirst;
     // Draw self if alive and in given pond
     if (Self.isAlive())
         a = Self.assignAntIf(a, World::viewTransform, first, last);
@@ -257,12 +270,107 @@ void DrawPondGroup(NimblePixMap& window, CompoundRegion& region, size_t first, s
             a = PondSet[k].assignDarkAnts(a, World::viewTransform);
         else
             a = PondSet[k].copyToAnts(a, World::viewTransform);
-    Ant::closeBufferAndDraw(window, region, a, first==0);
+    // When zoomed out, many beetles share a pixel, so keep one per square to bound the cost by the screen resolution.
+    float spacing = FLT_MAX;
+    for (size_t k=first; k<last; ++k)
+        if (const size_t m = PondSet[k].size())
+            spacing = Min(spacing, World::viewTransform.scale(std::sqrt(PondSet[k].area()/m)));
+    if (spacing<mergeSpacing)
+        a = MergeSubpixelAnts(antFirst, a, mergeCellSize);
+    Ant::closeBuffer(window, region, a, first==0);
+}
+
+//! Fraction of the host's frame period that World::draw aims to take when AdaptiveResolution is set.
+/** The rest of the frame goes to updating the world, drawing the meters, and presenting the frame. */
+constexpr double drawBudgetFraction = 0.5;
+
+//! Shortest frame period assumed, in seconds.  Keeps an unlimited frame rate from driving the resolution to its minimum.
+constexpr double framePeriodMin = 1.0/240;
+
+//! Intervals between frames longer than this many seconds are pauses, and are not used to estimate the frame period.
+constexpr double framePauseMin = 0.25;
+
+//! Resolutions chosen by ResolutionGovernor are multiples of this fraction of full resolution.
+constexpr float drawScaleStep = 1.0f/16;
+
+//! Lowest fraction of full resolution that ResolutionGovernor chooses.
+constexpr float drawScaleMin = 4*drawScaleStep;
+
+//! Chooses the fraction of full resolution at which to draw, from how long previous frames took.
+/** Drawing time is taken to be proportional to the number of pixels drawn, i.e. to the square of the fraction.
+    The budget is a fraction of the host's frame period, which is estimated from the shortest recent intervals
+    between frames, since a slow frame can only lengthen an interval. */
+class ResolutionGovernor {
+public:
+    //! Fraction of full resolution at which to draw the next frame.
+    float scale() const { return myScale; }
+    //! Account for a frame that started drawing at time start and took the given number of seconds to draw at scale().
+    void update(double start, double seconds);
+private:
+    float myScale = 1;
+    //! Smoothed estimate of how many seconds a frame would take at full resolution, or 0 if there is no estimate yet.
+    double myFullTime = 0;
+    //! Estimate of the host's frame period in seconds, or 0 if there is no estimate yet.
+    double myFramePeriod = 0;
+    //! Value of start for the previous frame, or 0 if there was none.
+    double myPreviousStart = 0;
+};
+
+void ResolutionGovernor::update(double start, double seconds) {
+    const double interval = start-myPreviousStart;
+    myPreviousStart = start;
+    if (0<interval && interval<framePauseMin) {
+        // Drop at once to a shorter interval, but creep up so that the estimate follows a change of display.
+        const double p = Max(interval, framePeriodMin);
+        myFramePeriod = myFramePeriod==0 || p<myFramePeriod ? p : myFramePeriod+0.01*(p-myFramePeriod);
+    }
+    if (myFramePeriod==0)
+        return;
+    const double t = seconds/(myScale*myScale);
+    myFullTime = myFullTime==0 ? t : 0.9*myFullTime+0.1*t;
+    const float ideal = float(std::sqrt(drawBudgetFraction*myFramePeriod/myFullTime));
+    // Drop at once when over budget, but rise only by whole steps, so that the resolution does not flicker between steps.
+    const float s = Clip(drawScaleMin, 1.0f, std::floor(ideal/drawScaleStep)*drawScaleStep);
+    if (ideal<myScale || s>myScale)
+        myScale = s;
 }
 
+ResolutionGovernor TheResolutionGovernor;
+
 } // (anonymous)
 
+bool AdaptiveResolution = true;
+
 void World::draw(NimblePixMap& window) {
+    if (!AdaptiveResolution) {
+        drawPonds(window);
+        return;
+    }
+    const double t0 = HostClockTime();
+    const float s = TheResolutionGovernor.scale();
+    const int width = Max(1, Round(window.width()*s));
+    const int height = Max(1, Round(window.height()*s));
+    if (width==window.width() && height==window.height()) {
+        drawPonds(window);
+    } else {
+        static NimblePixMapWithOwnership reduced;
+        if (reduced.width()!=width || reduced.height()!=height)
+            reduced = NimblePixMapWithOwnership(width, height);
+        // Draw with the view shrunk by s, then stretch the result over the window.
+        const ViewTransform full = viewTransform;
+        viewTransform.setScaleAndRotation(s*full.rotate(Point(1, 0)));
+        viewTransform.setOffset(s*full.transform(Point(0, 0)));
+        // Narrow the outlines too, so that they are as wide as at full resolution after stretching.
+        Outline::setWidth(Outline::lineWidth*s);
+        drawPonds(reduced);
+        Outline::setWidth(Outline::lineWidth);
+        viewTransform = full;
+        reduced.drawScaledOn(window);
+    }
+    TheResolutionGovernor.update(t0, HostClockTime()-t0);
+}
+
+void World::drawPonds(NimblePixMap& window) {
 #if 0 
     // Blank out background 
     window.draw(NimbleRect(0, 0, window.width(), window.height()), 0xFFFFFF);
@@ -271,6 +379,8 @@ void World::draw(NimblePixMap& window) {
     // where each bridge requires one positive shape and two negative shapes.
     static ConvexRegion RegionStorage[N_POND_MAX*4];
     static CompoundRegion CompoundRegionStorage[N_POND_MAX];
+    // Region of the pond group that each pond belongs to, or nullptr if the group is not visible
+    const CompoundRegion* regionOfPond[N_POND_MAX];
 
     size_t k;
     CompoundRegion* cFirst=CompoundRegionStorage;
@@ -291,6 +401,8 @@ void World::draw(NimblePixMap& window) {
             Assert(k<NumPond);
             rLast = BridgeSet[k-1].pushVisibleRegions(rLast);
         }
+        for (size_t j=start; j<k; ++j)
+            regionOfPond[j] = rFirst!=rLast ? cLast : nullptr;
         if (rFirst!=rLast) {
             cLast->build(rFirst, rLast);
             // Even if a region was clipped, we must include its beetles if any region shows, because
@@ -301,14 +413,15 @@ void World::draw(NimblePixMap& window) {
         }
     }
 
-    // For dark ponds, draw dots.
-    for (size_t k=0; k<NumPond; ++k)
-        if (PondSet[k].isDark())
-            Dot::draw(window, PondSet[k]);
-
     static CompoundRegion background;
     background.buildComplement(cFirst, cLast);
     DrawBackground(window, background);
+    Ant::drawClosedBuffers(window);
+
+    // For dark ponds, draw dots.
+    for (size_t k=0; k<NumPond; ++k)
+        if (PondSet[k].isDark() && regionOfPond[k])
+            Dot::draw(window, PondSet[k], *regionOfPond[k]);
 }
 
 void World::updatePonds(float dt) {
@@ -541,8 +654,15 @@ void World::checkHit(Beetle& b) {
         --kMin;
     while (kMax<NumPond-1 && !BridgeSet[kMax].isClosed())
         ++kMax;
-    static Neighbor buffer[N_ANT_MAX];
-    Neighborhood neighborhood(buffer, sizeof(buffer)/sizeof(buffer[0]));
+    // Neighborhood needs room for twice the number of points plus its three initial ghosts.
+    size_t n = 3;
+    for (size_t k=kMin; k<=kMax; ++k)
+        n += PondSet[k].size();
+    static std::vector<Neighbor> neighborBuffer;
+    if (neighborBuffer.size()<2*n)
+        neighborBuffer.resize(2*n);
+    Neighbor* const buffer = neighborBuffer.data();
+    Neighborhood neighborhood(buffer, neighborBuffer.size());
     neighborhood.start();
     Neighbor::indexType beginIndex[N_POND_MAX+1];
     Neighbor::indexType index=0;
@@ -20,6 +20,11 @@
 
 extern VoronoiMeter TheScoreMeter;
 
+//! If set, World::draw draws the ponds at a reduced resolution when needed to stay within its time budget,
+//! and stretches the result over the window.  The budget is a fraction of the host's measured frame period.
+//! The wizard key 'e' toggles it.
+extern bool AdaptiveResolution;
+
 #if WIZARD_ALLOWED
 void OpenBridgeToNextPond();
 void JumpToPond(int delta);
@@ -30,6 +35,8 @@ void Zoom(float factor);
 class World {
     static void updatePonds(float dt);
     static void updateSelfAndMissiles(NimblePixMap& window, float dt, float forward, float torque);
+    //! Draw ponds, self, and missiles on given window at the window's resolution.
+    static void drawPonds(NimblePixMap& window);
 public:
     //! Initialize world to start a new game
     static void initialize(NimblePixMap& window);
@@ -2,10 +2,12 @@
 
 void TestGeometry();
 void TestNeighborhood();
+void TestSort();
 void TestVoronoi();
 
 int main() {
     TestGeometry();
+    TestSort();
     TestVoronoi();
     TestNeighborhood();
     return 0;
@@ -0,0 +1,119 @@
+#include "AssertLib.h"
+#include "Sort.h"
+#include "Utility.h"
+#include <algorithm>
+#include <vector>
+
+//! Set to 1 to print timings that show the crossover points between the kernels in Sort.h.
+#define SORT_BENCHMARK 0
+
+#if SORT_BENCHMARK
+#include <chrono>
+#include <cstdio>
+#endif
+
+namespace {
+
+struct Item {
+    float key;
+    int id;
+};
+
+//! Check that KeySorter sorts n random items, including negative and duplicate keys.
+void TestKeySorter(KeySorter<Item>& sorter, size_t n) {
+    std::vector<Item> a(n);
+    for (size_t i=0; i<n; ++i) {
+        // Quantize some keys so that there are duplicates.
+        float k = RandomFloat(2000)-1000;
+        a[i].key = i%3==0 ? float(int(k)/16) : k;
+        a[i].id = int(i);
+    }
+    std::vector<Item> b = a;
+    sorter.sort(b.data(), b.data()+n, [](const Item& x) {return x.key; });
+    for (size_t i=1; i<n; ++i)
+        Assert(b[i-1].key<=b[i].key);
+    // Check that b is a permutation of a.
+    std::vector<bool> seen(n);
+    for (const Item& x: b) {
+        Assert(!seen[x.id]);
+        seen[x.id] = true;
+        Assert(a[x.id].key==x.key);
+    }
+}
+
+#if SORT_BENCHMARK
+const size_t benchmarkPool = 1<<16;
+
+//! Print nanoseconds per element for std::sort and each kernel, including the cost of building keys and gathering.
+/** Inputs rotate through a large pool so that branch predictors cannot learn them. */
+void BenchmarkSort() {
+    std::vector<float> pool(benchmarkPool);
+    for (float& x: pool)
+        x = RandomFloat(1920);
+    std::vector<const float*> ptr(benchmarkPool), work(benchmarkPool), tmp(benchmarkPool);
+    std::vector<int32_t> key(2*benchmarkPool), keyTmp(benchmarkPool);
+    std::vector<uint32_t> index(2*benchmarkPool), indexTmp(benchmarkPool);
+    for (size_t i=0; i<benchmarkPool; ++i)
+        ptr[i] = &pool[i];
+    std::printf("%6s %9s %9s %9s %9s (ns/element)\n", "n", "std::sort", "network", "bitonic", "radix");
+    for (size_t n=2; n<=benchmarkPool/2; n = n<8 ? n+1 : n*3/2) {
+        auto time = [&](auto kernel) {
+            const size_t reps = Max<size_t>(1, 400000/n);
+            double best = 1E9;
+            for (int trial=0; trial<5; ++trial) {
+                size_t offset = 0;
+                auto t0 = std::chrono::steady_clock::now();
+                for (size_t r=0; r<reps; ++r) {
+                    offset = (offset+7*n+13)%(benchmarkPool-n);
+                    std::copy_n(&ptr[offset], n, work.begin());
+                    kernel();
+                }
+                std::chrono::duration<double> t = std::chrono::steady_clock::now()-t0;
+                best = Min(best, t.count()/reps);
+            }
+            return best*1E9/n;
+        };
+        auto build = [&] {
+            for (size_t j=0; j<n; ++j) {
+                key[j] = OrderedKey(*work[j]);
+                index[j] = uint32_t(j);
+            }
+        };
+        auto gather = [&] {
+            for (size_t j=0; j<n; ++j)
+                tmp[j] = work[index[j]];
+            std::copy_n(tmp.begin(), n, work.begin());
+        };
+        double s = time([&] {std::sort(work.begin(), work.begin()+n, [](const float* a, const float* b) {return *a<*b; }); });
+        double w = n<=SORT_NETWORK_MAX ? time([&] {build(); SortKeysByNetwork(key.data(), index.data(), n); gather(); }) : 0;
+        double b = n<=16*SORT_BITONIC_MAX ? time([&] {build(); SortKeysBitonic(key.data(), index.data(), n); gather(); }) : 0;
+        double r = time([&] {build(); SortKeysRadix(key.data(), index.data(), keyTmp.data(), indexTmp.data(), n); gather(); });
+        std::printf("%6zu %9.2f %9.2f %9.2f %9.2f\n", n, s, w, b, r);
+    }
+}
+#endif
+
+} // (anonymous)
+
+void TestSort() {
+    // Check the OrderedKey mapping
+    const float special[] = {-1E30f, -3.f, -1E-30f, -0.f, 0.f, 1E-30f, 2.f, 1E30f};
+    for (float a: special)
+        for (float b: special)
+            if (a<b)
+                Assert(OrderedKey(a)<OrderedKey(b));
+            else if (a==b)
+                Assert(a==0 || OrderedKey(a)==OrderedKey(b));
+
+    // Exercise each kernel, and the boundaries between them
+    KeySorter<Item> sorter;
+    for (size_t n=0; n<=2*SORT_BITONIC_MAX+1; ++n)
+        for (int trial=0; trial<10; ++trial)
+            TestKeySorter(sorter, n);
+    for (size_t n: {1000, 5000, 20000})
+        TestKeySorter(sorter, n);
+
+#if SORT_BENCHMARK
+    BenchmarkSort();
+#endif
+}
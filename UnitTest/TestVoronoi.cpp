@@ -1,5 +1,755 @@
 #include "Voronoi.h"
+#include "Parallel.h"
 #include "Region.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+//! Room for the Ants of a small test diagram, including bookends.
+constexpr size_t N_TEST_ANT_MAX = 1<<15;
+
+//! Write a first bookend, n Ants, and a last bookend starting at ants, and return the end of what was written.
+/** The Ants are at random points in the rectangle with the given origin and size, and have random interior colors.
+    Ant k has the given exterior color if k is a multiple of outlinePeriod. */
+static Ant* FillRandomAnts(Ant* ants, size_t n, Point origin, Point size, OutlinedColor::exteriorColor exterior=0, size_t outlinePeriod=1) {
+    Assert(n+2<=N_TEST_ANT_MAX);
+    Ant* a = ants;
+    a->assignFirstBookend();
+    ++a;
+    for (size_t k=0; k<n; ++k) {
+        a->assign(origin+Point(RandomFloat(size.x), RandomFloat(size.y)), OutlinedColor(RandomUInt(0x1000000), k%outlinePeriod ? 0 : exterior));
+        ++a;
+    }
+    a->assignLastBookend();
+    ++a;
+    return a;
+}
+
+//! Check that sweeping the region in parallel stripes yields the same pixels as a single sweep.
+/** Some sites are duplicated exactly or nearly, since the sweeps must arbitrate between them the same way.
+    Every fourth trial puts the sites on a few rows, so that there are long runs of sites with equal y. */
+static void TestVoronoiStripes() {
+    const int width = 640;
+    const int height = 480;
+    static NimblePixel pixels[2][height][width];
+    static Ant ants[2][N_TEST_ANT_MAX];
+
+    SetRegionClip(0, 0, width, height, Outline::lineWidth);
+    ConvexRegion r;
+    r.makeCircle(Point(width/2, height/2), height/2+20);
+    CompoundRegion region;
+    region.build(&r, &r+1);
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFF00FF);
+
+    for (int trial=0; trial<20; ++trial) {
+        Ant* a = ants[0];
+        a->assignFirstBookend();
+        ++a;
+        const size_t n = 100+RandomUInt(2000);
+        for (size_t k=0; k<n; ++k) {
+            Point p(RandomFloat(width), RandomFloat(height));
+            if (trial%4==3)
+                p.y = float(RandomUInt(8)*height/8);
+            a->assign(p, OutlinedColor(RandomUInt(0x1000000), k%4 ? 0 : exterior));
+            ++a;
+            if (k%3==0) {
+                const float d[] = {0, 1E-5f, 0.01f};
+                a->assign(p+Polar(d[k/3%3], RandomAngle()), OutlinedColor(RandomUInt(0x1000000)));
+                ++a;
+            }
+        }
+        a->assignLastBookend();
+        ++a;
+        for (int k=0; k<2; ++k) {
+            std::copy(ants[0], a, ants[1]);
+            SetWorkerCount(k==0 ? 1 : 4);
+            NimblePixMap window(width, height, 32, pixels[k], sizeof(pixels[k][0]));
+            DrawVoronoi(window, region, ants[1], ants[1]+(a-ants[0]));
+        }
+        Assert(std::memcmp(pixels[0], pixels[1], sizeof(pixels[0]))==0);
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that drawing within a NimbleRect yields the same pixels as drawing within a CompoundRegion for it.
+static void TestVoronoiRectangle() {
+    const int width = 320;
+    const int height = 240;
+    static NimblePixel pixels[2][height][width];
+    static Ant ants[2][N_TEST_ANT_MAX];
+    const NimbleRect rect(10, 20, 300, 230);
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0x00FFFF);
+
+    for (int trial=0; trial<20; ++trial) {
+        // Odd trials have outlined cells.
+        Ant* const a = FillRandomAnts(ants[0], 10+RandomUInt(500), Point(0, 0), Point(width, height), trial%2 ? exterior : 0, 4);
+        for (int k=0; k<2; ++k) {
+            std::copy(ants[0], a, ants[1]);
+            std::fill(pixels[k][0], pixels[k][0]+width*height, NimblePixel(0));
+            NimblePixMap window(width, height, 32, pixels[k], sizeof(pixels[k][0]));
+            if (k==0) {
+                CompoundRegion region;
+                region.buildRectangle(Point(rect.left, rect.top), Point(rect.right, rect.bottom));
+                DrawVoronoi(window, region, ants[1], ants[1]+(a-ants[0]));
+            } else {
+                DrawVoronoi(window, rect, ants[1], ants[1]+(a-ants[0]));
+            }
+        }
+        Assert(std::memcmp(pixels[0], pixels[1], sizeof(pixels[0]))==0);
+    }
+}
+
+//! Check that an outlined cell far from x=0 is shaded the same as one near it.
+/** Each cell is the only one in its rectangle, so it is a translated copy of the other. */
+static void TestVoronoiOutlineOffset() {
+    const int width = 1280;
+    const int height = 64;
+    static NimblePixel pixels[height][width];
+    static Ant ants[3];
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFF00FF);
+    const int offset = 1000;
+    std::fill(pixels[0], pixels[0]+width*height, NimblePixel(0));
+    NimblePixMap window(width, height, 32, pixels, sizeof(pixels[0]));
+    for (int k=0; k<2; ++k) {
+        const NimbleRect rect(k*offset+10, 8, k*offset+60, 56);
+        ants[0].assignFirstBookend();
+        ants[1].assign(Point(k*offset+35, 32), OutlinedColor(0x123456, exterior));
+        ants[2].assignLastBookend();
+        DrawVoronoi(window, rect, ants, ants+3);
+    }
+    for (int y=0; y<height; ++y)
+        Assert(std::equal(pixels[y], pixels[y]+width-offset, pixels[y]+offset));
+    // The outline must have been drawn, not just the interior color.
+    Assert(pixels[8][10]!=pixels[32][35]);
+}
+
+//! Check that a narrower Outline::width() blends to the interior color closer to the edge of a cell.
+static void TestVoronoiOutlineWidth() {
+    const int width = 64;
+    const int height = 64;
+    static NimblePixel pixels[2][height][width];
+    static Ant ants[3];
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFF00FF);
+    const NimblePixel interior = 0x123456;
+    const NimbleRect rect(8, 8, 56, 56);
+    for (int k=0; k<2; ++k) {
+        Outline::setWidth(k==0 ? Outline::lineWidth : 0.5f*Outline::lineWidth);
+        ants[0].assignFirstBookend();
+        ants[1].assign(Point(32, 32), OutlinedColor(interior, exterior));
+        ants[2].assignLastBookend();
+        NimblePixMap window(width, height, 32, pixels[k], sizeof(pixels[k][0]));
+        DrawVoronoi(window, rect, ants, ants+3);
+    }
+    Outline::setWidth(Outline::lineWidth);
+    // Both outlines start with the exterior color.
+    Assert(pixels[0][32][8]==pixels[1][32][8]);
+    // Pixel 4 in from the edge is 5 from the nearest outside pixel.
+    Assert(pixels[0][32][12]!=interior);
+    Assert(pixels[1][32][12]==interior);
+    Assert(pixels[0][32][32]==interior);
+}
+
+//! Check that outline shading matches a brute-force distance to the nearest pixel outside each cell.
+/** The cells are drawn directly with Outline, so that they can be non-convex and have several segments per row.
+    Some cells extend past the edges of the window, where their outside pixels are not drawn. */
+static void TestVoronoiOutlineDistance() {
+    const int width = 96;
+    const int height = 64;
+    // Cells cover a margin around the window.  Pixels within cap-1 of the window are inside the margin.
+    const int cap = Outline::lineWidth+2;
+    const int margin = cap;
+    // Squared distances of (lineWidth+1)^2 or more all map to the interior color.
+    const int dist2Max = (Outline::lineWidth+1)*(Outline::lineWidth+1);
+    const int nCellMax = 20;
+    const NimblePixel unset = 0x7F7F7F;
+    static NimblePixel pixels[height][width];
+    static int cell[height+2*margin][width+2*margin];
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFFFFFF);
+    Assert(Outline::width()==Outline::lineWidth);
+    auto cellAt = [&](int x, int y) {return cell[y+margin][x+margin]; };
+    for (int trial=0; trial<20; ++trial) {
+        // Label each pixel with the seed of least weighted distance, or 0 if all seeds are far away.
+        // Weights make the cells non-convex, and some split into pieces.
+        const int nCell = 2+RandomUInt(nCellMax-1);
+        Point seed[nCellMax+1];
+        float weight[nCellMax+1];
+        bool outlined[nCellMax+1];
+        NimblePixel interior[nCellMax+1];
+        // Label 0 is not a cell.
+        outlined[0] = false;
+        for (int c=1; c<=nCell; ++c) {
+            seed[c] = Point(RandomFloat(width+2*margin)-margin, RandomFloat(height+2*margin)-margin);
+            weight[c] = 0.5f+RandomFloat(1.5f);
+            outlined[c] = RandomUInt(4)!=0;
+            // Dark interiors differ enough from the white exterior that distinct distances get distinct shades.
+            interior[c] = RandomUInt(0x40)*0x010101;
+        }
+        const float far = 40*40;
+        for (int y=-margin; y<height+margin; ++y)
+            for (int x=-margin; x<width+margin; ++x) {
+                int best = 0;
+                float bestDist = far;
+                for (int c=1; c<=nCell; ++c) {
+                    const float d = weight[c]*Dist2(Point(x+0.5f, y+0.5f), seed[c]);
+                    if (d<bestDist) {
+                        best = c;
+                        bestDist = d;
+                    }
+                }
+                cell[y+margin][x+margin] = best;
+            }
+
+        // Draw each row's runs of outlined cells.
+        std::fill(pixels[0], pixels[0]+width*height, unset);
+        Outline::start(1, nCell);
+        Outline::Stripe& stripe = Outline::stripe(0);
+        for (int y=-margin; y<height+margin; ++y)
+            for (int x=-margin; x<width+margin; ) {
+                const int c = cellAt(x, y);
+                const int left = x;
+                while (x<width+margin && cellAt(x, y)==c)
+                    ++x;
+                if (outlined[c])
+                    stripe.addSegment(Outline::idOfAnt(c), left, x, y, OutlinedColor(interior[c], exterior));
+            }
+        NimblePixMap window(width, height, 32, pixels, sizeof(pixels[0]));
+        Outline::finishAndDraw(window);
+
+        // shade[c][d] is the color seen for squared distance d in cell c.
+        NimblePixel shade[nCellMax+1][dist2Max+1];
+        std::fill(shade[0], shade[0]+(nCellMax+1)*(dist2Max+1), unset);
+        for (int y=0; y<height; ++y)
+            for (int x=0; x<width; ++x) {
+                const int c = cellAt(x, y);
+                if (!outlined[c]) {
+                    Assert(pixels[y][x]==unset);
+                    continue;
+                }
+                int d2 = cap*cap;
+                for (int dy=1-cap; dy<cap; ++dy)
+                    for (int dx=1-cap; dx<cap; ++dx)
+                        if (cellAt(x+dx, y+dy)!=c)
+                            d2 = Min(d2, dx*dx+dy*dy);
+                d2 = Min(d2, dist2Max);
+                const NimblePixel p = pixels[y][x];
+                if (d2==1)
+                    Assert(p==0xFFFFFF);
+                if (d2==dist2Max)
+                    Assert(p==interior[c]);
+                if (shade[c][d2]==unset)
+                    shade[c][d2] = p;
+                else
+                    Assert(shade[c][d2]==p);
+            }
+        // The ramp is strictly monotone, so different distances must have different shades.
+        for (int c=1; c<=nCell; ++c)
+            for (int d=1; d<=dist2Max; ++d)
+                for (int e=1; e<d; ++e)
+                    Assert(shade[c][d]==unset || shade[c][d]!=shade[c][e]);
+    }
+}
+
+//! Check that drawing several diagrams together yields the same pixels as drawing them one at a time.
+static void TestVoronoiDiagrams() {
+    const int width = 640;
+    const int height = 480;
+    static NimblePixel pixels[2][height][width];
+    static Ant ants[2][N_TEST_ANT_MAX];
+
+    SetRegionClip(0, 0, width, height, Outline::lineWidth);
+    ConvexRegion r[2];
+    r[0].makeCircle(Point(200, 200), 150);
+    r[1].makeCircle(Point(500, 300), 100);
+    CompoundRegion region[3];
+    region[0].build(&r[0], &r[0]+1);
+    region[1].build(&r[1], &r[1]+1);
+    region[2].buildComplement(region, region+2);
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFFFF00);
+
+    for (int trial=0; trial<10; ++trial) {
+        // Diagram k has Ants [first[k],first[k+1]).  The background diagram is not outlined.
+        size_t first[4];
+        Ant* a = ants[0];
+        for (int k=0; k<3; ++k) {
+            first[k] = a-ants[0];
+            a = FillRandomAnts(a, 1+RandomUInt(1000), Point(0, 0), Point(width, height), k<2 ? exterior : 0, 3);
+        }
+        first[3] = a-ants[0];
+        for (int k=0; k<2; ++k) {
+            std::copy(ants[0], a, ants[1]);
+            SetWorkerCount(k==0 ? 1 : 4);
+            NimblePixMap window(width, height, 32, pixels[k], sizeof(pixels[k][0]));
+            if (k==0) {
+                for (int j=0; j<3; ++j)
+                    DrawVoronoi(window, region[j], ants[1]+first[j], ants[1]+first[j+1]);
+            } else {
+                VoronoiDiagram d[3];
+                for (int j=0; j<3; ++j)
+                    d[j] = {&region[j], ants[1]+first[j], ants[1]+first[j+1]};
+                DrawVoronoi(window, d, d+3);
+            }
+        }
+        Assert(std::memcmp(pixels[0], pixels[1], sizeof(pixels[0]))==0);
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that diagrams with more Ants than fit in a small test diagram draw the same in stripes as in a single sweep.
+static void TestVoronoiLarge() {
+    const int width = 640;
+    const int height = 480;
+    static NimblePixel pixels[2][height][width];
+    const size_t n = 100000;
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFFFF00);
+    // Outlined trial has more ids than fit in 16 bits, and more segments than a stripe initially holds.
+    for (bool outlined: {false, true}) {
+        std::vector<Ant> ants[2];
+        ants[0].resize(n+2);
+        ants[0][0].assignFirstBookend();
+        for (size_t k=1; k<=n; ++k)
+            ants[0][k].assign(Point(RandomFloat(width), RandomFloat(height)), OutlinedColor(RandomUInt(0x1000000), outlined ? exterior : 0));
+        ants[0][n+1].assignLastBookend();
+        for (int k=0; k<2; ++k) {
+            ants[1] = ants[0];
+            SetWorkerCount(k==0 ? 1 : 4);
+            NimblePixMap window(width, height, 32, pixels[k], sizeof(pixels[k][0]));
+            DrawVoronoi(window, NimbleRect(0, 0, width, height), ants[1].data(), ants[1].data()+ants[1].size());
+            if (outlined) {
+                const VoronoiStats& s = LastVoronoiStats();
+                Assert(s.count[VoronoiStat::outlineIds]==n);
+                Assert(s.count[VoronoiStat::outlineSegments]==Outline::lastStats().segments);
+                Assert(Outline::highWater().ids>=n);
+                Assert(Outline::highWater().segments>=Outline::lastStats().segments);
+            }
+        }
+        Assert(std::memcmp(pixels[0], pixels[1], sizeof(pixels[0]))==0);
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that a nearly horizontal bisector on a 4K-wide window splits each scan line where the exact bisector does.
+/** The bisector moves thousands of pixels per scan line, more than a boundary's slope can hold.  Far from the sites,
+    both sites are almost equally near, so the check is against the exact intercept rather than distances. */
+static void TestVoronoiSteepBisectors() {
+    const int width = 3840;
+    const int height = 48;
+    static uint32_t ids[height][width];
+    static Ant ants[4];
+    const NimbleRect rect(0, 0, width, height);
+
+    for (int trial=0; trial<200; ++trial) {
+        // Sites almost directly above one another, so the bisector between them has a slope of more than 4000.
+        const Point l(RandomFloat(width), RandomFloat(height));
+        const Point r(l.x+std::nextafter(RandomFloat(0.0005f), 1.0f), l.y+1+RandomFloat(8));
+        ants[0].assignFirstBookend();
+        ants[1].assign(l, OutlinedColor(0));
+        ants[2].assign(r, OutlinedColor(0));
+        ants[3].assignLastBookend();
+        SetWorkerCount(trial%2 ? 4 : 1);
+        DrawVoronoi<uint32_t>(nullptr, rect, ants, ants+4, {ids[0], width, width, height, nullptr});
+        // Sorting may have swapped the sites.
+        const Point p[2] = {Point(ants[1].x, ants[1].y), Point(ants[2].x, ants[2].y)};
+        for (int y=0; y<height; ++y) {
+            // Scan line y is sampled at y.
+            const double slope = (double(p[0].y)-p[1].y)/(double(p[1].x)-p[0].x);
+            const double intercept = 0.5*(double(p[0].x)+p[1].x) + slope*(y-0.5*(double(p[0].y)+p[1].y));
+            for (int x=0; x<width; ++x) {
+                if (std::abs(x+0.5-intercept)<=1.5)
+                    continue;
+                auto dist2 = [=](Point q) {return (x+0.5-q.x)*(x+0.5-q.x)+(double(y)-q.y)*(double(y)-q.y); };
+                const uint32_t id = ids[y][x];
+                Assert(id==(dist2(p[0])<dist2(p[1]) ? 1 : 2));
+            }
+        }
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that each pixel of an 8K-wide window is in the cell of a nearest site.
+/** The window is wider than 32-bit fixed-point boundaries could hold.  Pixels almost equally near two sites are skipped. */
+static void TestVoronoiWideWindow() {
+    const int width = 7680;
+    const int height = 32;
+    static uint32_t ids[height][width];
+    static Ant ants[N_TEST_ANT_MAX];
+    const NimbleRect rect(0, 0, width, height);
+
+    for (int trial=0; trial<4; ++trial) {
+        const size_t n = 20+RandomUInt(40);
+        Ant* const a = FillRandomAnts(ants, n, Point(0, 0), Point(width, height));
+        SetWorkerCount(trial%2 ? 4 : 1);
+        DrawVoronoi<uint32_t>(nullptr, rect, ants, a, {ids[0], width, width, height, nullptr});
+        for (int y=0; y<height; ++y)
+            for (int x=0; x<width; ++x) {
+                // Scan line y is sampled at y.
+                auto dist = [=](const Ant& b) {return std::hypot(x+0.5-b.x, double(y)-b.y); };
+                double d[2] = {DBL_MAX, DBL_MAX};
+                for (size_t k=1; k<=n; ++k) {
+                    const double e = dist(ants[k]);
+                    if (e<d[0]) {
+                        d[1] = d[0];
+                        d[0] = e;
+                    } else if (e<d[1]) {
+                        d[1] = e;
+                    }
+                }
+                const uint32_t id = ids[y][x];
+                Assert(1<=id && id<=n);
+                Assert(dist(ants[id])==d[0] || d[1]-d[0]<=1.5);
+            }
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that pairs of sites with the same x and adjacent y values are resolved to a nearest site.
+static void TestVoronoiNearDuplicates() {
+    const int width = 320;
+    const int height = 240;
+    static uint32_t ids[height][width];
+    static Ant ants[N_TEST_ANT_MAX];
+    const NimbleRect rect(0, 0, width, height);
+
+    for (int trial=0; trial<20; ++trial) {
+        Ant* a = ants;
+        a->assignFirstBookend();
+        ++a;
+        const size_t n = 1+RandomUInt(200);
+        for (size_t k=0; k<n; ++k) {
+            const Point p(RandomFloat(width), RandomFloat(height));
+            a->assign(p, OutlinedColor(RandomUInt(0x1000000)));
+            ++a;
+            a->assign(Point(p.x, std::nextafter(p.y, trial%2 ? FLT_MAX : -FLT_MAX)), OutlinedColor(RandomUInt(0x1000000)));
+            ++a;
+        }
+        a->assignLastBookend();
+        ++a;
+        SetWorkerCount(trial%4<2 ? 4 : 1);
+        DrawVoronoi<uint32_t>(nullptr, rect, ants, a, {ids[0], width, width, height, nullptr});
+        for (int y=0; y<height; ++y)
+            for (int x=0; x<width; ++x) {
+                const Point p(x+0.5f, y+0.5f);
+                float d2 = FLT_MAX;
+                for (const Ant* b=ants+1; b!=a-1; ++b)
+                    d2 = Min(d2, Dist2(p, Point(b->x, b->y)));
+                const uint32_t id = ids[y][x];
+                Assert(0<id && id<uint32_t(a-ants-1));
+                // Spans are rounded to whole pixels, so a pixel may belong to a cell whose site is up to
+                // a diagonal pixel farther away than the nearest site.
+                Assert(Distance(p, Point(ants[id].x, ants[id].y)) <= std::sqrt(d2)+1.5f);
+            }
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that cell ids match the drawn pixels, and that the visible set is the set of ids written.
+static void TestVoronoiIds() {
+    const int width = 320;
+    const int height = 240;
+    static NimblePixel pixels[height][width];
+    static uint32_t ids32[height][width];
+    static uint16_t ids16[height][width];
+    static Ant ants[N_TEST_ANT_MAX];
+    const NimblePixel noPixel = 0xFF000000;
+
+    SetRegionClip(0, 0, width, height, Outline::lineWidth);
+    ConvexRegion r;
+    r.makeCircle(Point(width/2, height/2), 100);
+    CompoundRegion region;
+    region.build(&r, &r+1);
+    const NimbleRect rect(10, 20, 300, 230);
+
+    for (int trial=0; trial<20; ++trial) {
+        Ant* const a = FillRandomAnts(ants, 10+RandomUInt(2000), Point(0, 0), Point(width, height));
+        SetWorkerCount(trial%2 ? 4 : 1);
+        std::fill(pixels[0], pixels[0]+width*height, noPixel);
+        std::fill(ids32[0], ids32[0]+width*height, ~0u);
+        std::fill(ids16[0], ids16[0]+width*height, uint16_t(~0u));
+        NimblePixMap window(width, height, 32, pixels, sizeof(pixels[0]));
+        std::vector<uint32_t> visible[2];
+        // Trials 0,1 mod 4 draw within the region, and trials 2,3 mod 4 within the rectangle.
+        if (trial%4<2) {
+            DrawVoronoi(&window, region, ants, a, VoronoiIdMap<uint32_t>{ids32[0], width, width, height, &visible[0]});
+            DrawVoronoi<uint16_t>(nullptr, region, ants, a, {ids16[0], width, width, height, &visible[1]});
+        } else {
+            DrawVoronoi(&window, rect, ants, a, VoronoiIdMap<uint32_t>{ids32[0], width, width, height, &visible[0]});
+            DrawVoronoi<uint16_t>(nullptr, rect, ants, a, {ids16[0], width, width, height, &visible[1]});
+        }
+        std::vector<bool> written(a-ants);
+        for (int y=0; y<height; ++y)
+            for (int x=0; x<width; ++x) {
+                const uint32_t id = ids32[y][x];
+                if (pixels[y][x]==noPixel) {
+                    Assert(id==~0u);
+                } else {
+                    Assert(0<id && id<uint32_t(a-ants-1));
+                    Assert(ants[id].color.interior()==pixels[y][x]);
+                    written[id] = true;
+                }
+                Assert(ids16[y][x]==uint16_t(id));
+            }
+        Assert(visible[0]==visible[1]);
+        Assert(size_t(std::count(written.begin(), written.end(), true))==visible[0].size());
+        for (uint32_t i: visible[0])
+            Assert(written[i]);
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that cell statistics match those computed from cell ids.
+static void TestVoronoiStats() {
+    const int width = 320;
+    const int height = 240;
+    static NimblePixel source[height][width];
+    static uint32_t ids[height][width];
+    static Ant ants[N_TEST_ANT_MAX];
+    for (int y=0; y<height; ++y)
+        for (int x=0; x<width; ++x)
+            source[y][x] = RandomUInt(0x1000000);
+    NimblePixMap sourceMap(width, height, 32, source, sizeof(source[0]));
+
+    SetRegionClip(0, 0, width, height, Outline::lineWidth);
+    ConvexRegion r;
+    r.makeCircle(Point(width/2, height/2), 130);
+    CompoundRegion region;
+    region.build(&r, &r+1);
+    const NimbleRect rect(10, 20, 300, 230);
+
+    for (int trial=0; trial<20; ++trial) {
+        Ant* const a = FillRandomAnts(ants, 10+RandomUInt(2000), Point(0, 0), Point(width, height));
+        SetWorkerCount(trial%2 ? 4 : 1);
+        std::fill(ids[0], ids[0]+width*height, ~0u);
+        std::vector<VoronoiCellStats> stats;
+        // Trials 0,1 mod 4 use the region, and trials 2,3 mod 4 use the rectangle.
+        if (trial%4<2) {
+            DrawVoronoi(nullptr, region, ants, a, stats, &sourceMap);
+            DrawVoronoi<uint32_t>(nullptr, region, ants, a, {ids[0], width, width, height, nullptr});
+        } else {
+            DrawVoronoi(nullptr, rect, ants, a, stats, &sourceMap);
+            DrawVoronoi<uint32_t>(nullptr, rect, ants, a, {ids[0], width, width, height, nullptr});
+        }
+        std::vector<VoronoiCellStats> expected(a-ants);
+        for (VoronoiCellStats& c: expected)
+            c.clear();
+        for (int y=0; y<height; ++y)
+            for (int x=0; x<width; ++x)
+                if (ids[y][x]!=~0u)
+                    expected[ids[y][x]].addSpan(y, x, x+1, &sourceMap);
+        Assert(stats.size()==expected.size());
+        for (size_t i=0; i<stats.size(); ++i) {
+            const VoronoiCellStats& s = stats[i];
+            const VoronoiCellStats& e = expected[i];
+            Assert(s.area==e.area);
+            Assert(s.sumX==e.sumX && s.sumY==e.sumY);
+            Assert(s.sumRed==e.sumRed && s.sumGreen==e.sumGreen && s.sumBlue==e.sumBlue);
+            if (s.area>0) {
+                Assert(s.box.left==e.box.left && s.box.right==e.box.right);
+                Assert(s.box.top==e.box.top && s.box.bottom==e.box.bottom);
+                Assert(e.box.contains(NimblePoint(int(s.centroid().x), int(s.centroid().y))));
+            }
+        }
+    }
+    SetWorkerCount(0);
+}
+
+//! Check that drawing a stream of Ants yields the same pixels as drawing them within a rectangle.
+static void TestVoronoiStream() {
+    const int width = 200;
+    const int height = 400;
+    static NimblePixel pixels[2][height][width];
+    static Ant ants[2][N_TEST_ANT_MAX];
+
+    for (int trial=0; trial<5; ++trial) {
+        Ant* a = ants[0];
+        a->assignFirstBookend();
+        ++a;
+        // Enough Ants to make the stream discard some.  Some are outside the image.  The first stream is empty.
+        const size_t n = trial==0 ? 0 : trial==1 ? 1 : 30000;
+        for (size_t k=0; k<n; ++k) {
+            a->assign(Point(RandomFloat(width+40)-20, RandomFloat(height+40)-20), OutlinedColor(RandomUInt(0x1000000)));
+            ++a;
+        }
+        a->assignLastBookend();
+        ++a;
+        std::sort(ants[0]+1, a-1, Ant::lessY());
+        std::copy(ants[0], a, ants[1]);
+        // DrawVoronoi needs at least one Ant.
+        if (n>0) {
+            NimblePixMap window(width, height, 32, pixels[0], sizeof(pixels[0][0]));
+            DrawVoronoi(window, NimbleRect(0, 0, width, height), ants[1], ants[1]+(a-ants[0]));
+        }
+
+        // Read the stream in chunks of random size.
+        const Ant* next = ants[0]+1;
+        const Ant* const last = a-1;
+        int nextRow = 0;
+        DrawVoronoiStream(width, height, [&](Ant* buffer, size_t m) {
+            size_t k = std::min<size_t>({m, size_t(last-next), 1+RandomUInt(100)});
+            std::copy(next, next+k, buffer);
+            next += k;
+            return k;
+        }, [&](int y, const NimblePixel* row) {
+            Assert(y==nextRow++);
+            std::copy(row, row+width, pixels[1][y]);
+        });
+        Assert(nextRow==height);
+        Assert(n==0 || std::memcmp(pixels[0], pixels[1], sizeof(pixels[0]))==0);
+        // Every row is counted once, as by DrawVoronoi.
+        const VoronoiStats& s = LastVoronoiStats();
+        Assert(s.count[VoronoiStat::linesSwept]+s.count[VoronoiStat::linesEmpty]==uint64_t(height));
+        Assert(s.count[VoronoiStat::linesEmpty]==(n==0 ? uint64_t(height) : 0));
+    }
+}
+
+//! Check that the counters of DrawVoronoi are consistent with what was drawn.
+static void TestVoronoiCounters() {
+    const int width = 320;
+    const int height = 240;
+    static NimblePixel pixels[height][width];
+    static Ant ants[N_TEST_ANT_MAX];
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0x00FFFF);
+    const NimbleRect rect(10, 20, 300, 230);
+    NimblePixMap window(width, height, 32, pixels, sizeof(pixels[0]));
+
+    TakeVoronoiFrameStats();
+    VoronoiStats sum;
+    for (int trial=0; trial<10; ++trial) {
+        const size_t n = 1+RandomUInt(1000);
+        // Odd trials have outlined cells.
+        Ant* const a = FillRandomAnts(ants, n, Point(0, 0), Point(width, height), trial%2 ? exterior : 0);
+        SetWorkerCount(trial%4 ? 4 : 1);
+        DrawVoronoi(window, rect, ants, a);
+        const VoronoiStats& s = LastVoronoiStats();
+        Assert(s.count[VoronoiStat::antsIn]==n);
+        Assert(s.count[VoronoiStat::linesSwept]+s.count[VoronoiStat::linesEmpty]==uint64_t(rect.bottom-rect.top));
+        Assert(s.count[VoronoiStat::antsInserted]>=1);
+        Assert(s.count[VoronoiStat::spans]>=s.count[VoronoiStat::linesSwept]);
+        Assert(s.count[VoronoiStat::liveMax]>=1 && s.count[VoronoiStat::liveMax]<=n);
+        Assert(s.count[VoronoiStat::pops]<=s.count[VoronoiStat::pushes]);
+        Assert((s.count[VoronoiStat::outlineSegments]>0)==(trial%2==1));
+        Assert(s.count[VoronoiStat::outlineIds]==(trial%2 ? n : 0));
+        sum += s;
+    }
+    SetWorkerCount(0);
+    const VoronoiStats frame = TakeVoronoiFrameStats();
+    for (VoronoiStat i=VoronoiStat(0); i<=EnumMax<VoronoiStat>; i=VoronoiStat(int(i)+1))
+        Assert(frame.count[i]==sum.count[i]);
+    Assert(TakeVoronoiFrameStats().count[VoronoiStat::antsIn]==0);
+
+    VoronoiStatsHistogram h;
+    h.add(frame);
+    h.add(VoronoiStats());
+    Assert(h(VoronoiStat::linesEmpty, 0)>=1);
+    Assert(h(VoronoiStat::spans, 0)==1);
+}
+
+//! Check that culling hidden Ants does not change the pixels drawn, and that it drops Ants far from the region.
+static void TestVoronoiCulling() {
+    const int width = 640;
+    const int height = 480;
+    static NimblePixel pixels[2][height][width];
+    static Ant ants[2][N_TEST_ANT_MAX];
+
+    SetRegionClip(0, 0, width, height, Outline::lineWidth);
+    ConvexRegion r;
+    r.makeCircle(Point(width/2, height/2), 200);
+    CompoundRegion region;
+    region.build(&r, &r+1);
+    const NimbleRect rect(10, 20, 300, 230);
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0x00FF00);
+
+    for (int trial=0; trial<40; ++trial) {
+        // Ants are spread over an area that is several times larger than the window, as when zoomed in.
+        // Odd trials are sparse, so that cells are bigger than the grid used for culling.
+        const float spread = 1+RandomFloat(4);
+        const size_t n = trial%2 ? 70+RandomUInt(100) : 500+RandomUInt(4000);
+        const Point size(spread*width, spread*height);
+        Ant* const a = FillRandomAnts(ants[0], n, Point(width/2, height/2)-0.5f*size, size, exterior, 4);
+        // CullHiddenAnts requires Ants sorted by y.
+        std::sort(ants[0]+1, a-1, Ant::lessY());
+        const size_t m = a-ants[0];
+        size_t kept = 0;
+        for (int k=0; k<2; ++k) {
+            std::copy(ants[0], a, ants[1]);
+            Ant* last = ants[1]+m;
+            if (k==1) {
+                Ant* e = trial%4<2 ? CullHiddenAnts(ants[1]+1, last-1, region) : CullHiddenAnts(ants[1]+1, last-1, rect);
+                kept = e-(ants[1]+1);
+                Assert(kept>0);
+                (e++)->assignLastBookend();
+                last = e;
+            }
+            std::fill(pixels[k][0], pixels[k][0]+width*height, NimblePixel(0));
+            NimblePixMap window(width, height, 32, pixels[k], sizeof(pixels[k][0]));
+            if (trial%4<2)
+                DrawVoronoi(window, region, ants[1], last);
+            else
+                DrawVoronoi(window, rect, ants[1], last);
+        }
+        Assert(std::memcmp(pixels[0], pixels[1], sizeof(pixels[0]))==0);
+        // A dense diagram spread over an area at least 4x the window loses most of its Ants.
+        if (trial%2==0 && spread>=2)
+            Assert(kept<n/2);
+    }
+}
+
+//! Check that MergeSubpixelAnts keeps one Ant per square, chosen the same way whatever the order of the Ants.
+/** The kept Ant is outlined if any in the square are, and is the nearest to the square's center. */
+static void TestVoronoiMerging() {
+    static Ant ants[2][N_TEST_ANT_MAX];
+    static const OutlinedColor::exteriorColor exterior = OutlinedColor::newExteriorColor(0xFF00FF);
+    for (int trial=0; trial<20; ++trial) {
+        const float cellSize = trial%2 ? 1.0f : 2.5f;
+        const size_t n = 1+RandomUInt(5000);
+        // MergeSubpixelAnts does not take bookends, so the Ants are [first,first+n).
+        Ant* const first = ants[0]+1;
+        FillRandomAnts(ants[0], n, Point(-20, -20), Point(100, 100), exterior, 8);
+        for (size_t k=0; k<n; ++k) {
+            // Some Ants are far away, and some sit exactly on the edges of squares.
+            if (k%50==0)
+                first[k].assign(Point(RandomFloat(2E9f)-1E9f, RandomFloat(2E9f)-1E9f), first[k].color);
+            else if (k%7==0)
+                first[k].assign(Point(int(RandomUInt(40))*cellSize, int(RandomUInt(40))*cellSize), first[k].color);
+        }
+        auto squareOf = [=](const Ant& a) {
+            return std::make_pair(std::floor(a.y/cellSize), std::floor(a.x/cellSize));
+        };
+        // Square of each kept Ant, from merging the Ants in their original order.
+        std::map<std::pair<float, float>, Ant> expected;
+        std::copy(first, first+n, ants[1]);
+        for (Ant* a=ants[1], *e=MergeSubpixelAnts(ants[1], ants[1]+n, cellSize); a<e; ++a)
+            Assert(expected.insert(std::make_pair(squareOf(*a), *a)).second);
+        for (size_t k=0; k<n; ++k) {
+            const Ant& a = first[k];
+            const auto i = expected.find(squareOf(a));
+            Assert(i!=expected.end());
+            const Ant& b = i->second;
+            // No Ant in the square is better than the kept one.
+            Assert(!a.color.hasExterior() || b.color.hasExterior());
+            if (a.color.hasExterior()==b.color.hasExterior()) {
+                const Point center((i->first.second+0.5f)*cellSize, (i->first.first+0.5f)*cellSize);
+                Assert(Dist2(b, center)<=Dist2(a, center));
+            }
+        }
+        // Merging the Ants in other orders keeps the same Ants.
+        for (int k=0; k<2; ++k) {
+            std::copy(first, first+n, ants[1]);
+            if (k==0)
+                std::reverse(ants[1], ants[1]+n);
+            else
+                std::random_shuffle(ants[1], ants[1]+n, [](uint32_t m) {return RandomUInt(m);});
+            Ant* e = MergeSubpixelAnts(ants[1], ants[1]+n, cellSize);
+            Assert(size_t(e-ants[1])==expected.size());
+            for (const Ant* a=ants[1]; a<e; ++a) {
+                const Ant& b = expected.at(squareOf(*a));
+                Assert(a->x==b.x && a->y==b.y && a->color.interior()==b.color.interior());
+            }
+        }
+    }
+}
 
 void TestVoronoi() {
     NimblePixel pixels[100][100];
@@ -13,8 +763,8 @@ void TestVoronoi() {
     region.build(&r,&r+1);
 
     for( int trial=0; trial<1000; ++trial ) {
-        static Ant ants[N_ANT_MAX];
-        NimblePixel color[N_ANT_MAX];
+        static Ant ants[N_TEST_ANT_MAX];
+        NimblePixel color[N_TEST_ANT_MAX];
         Ant* a = ants;
         a->assignFirstBookend();
         ++a;
@@ -33,4 +783,20 @@ void TestVoronoi() {
         ++a;
         DrawVoronoi( window, region, ants, a );
     }
-}
\ No newline at end of file
+    TestVoronoiStripes();
+    TestVoronoiRectangle();
+    TestVoronoiOutlineOffset();
+    TestVoronoiOutlineWidth();
+    TestVoronoiOutlineDistance();
+    TestVoronoiDiagrams();
+    TestVoronoiLarge();
+    TestVoronoiNearDuplicates();
+    TestVoronoiSteepBisectors();
+    TestVoronoiWideWindow();
+    TestVoronoiStream();
+    TestVoronoiIds();
+    TestVoronoiStats();
+    TestVoronoiCounters();
+    TestVoronoiCulling();
+    TestVoronoiMerging();
+}